@@ -0,0 +1,350 @@
+/* ---------------------------------------------------------------
+ *
+ * astervoid-load.c
+ *
+ * Copyright (C) 2017-2018, 2021 Matthew Love <matthew.love@colorado.edu>
+ *
+ * This file is liscensed under the GPL v.2 or later and
+ * is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * <http://www.gnu.org/licenses/>
+ *
+ * Drives a real astervoid through a pty with a keystroke schedule
+ * and reports how it held up: missed frame deadlines and worst
+ * frame time (from the game's own counters) and RSS drift.
+ * With -r it restarts the game as fast as it will go instead,
+ * which should leave RSS flat. With -n it starts one astervoid
+ * hosting that many sessions, each on its own pty, sends every
+ * key to all of them and reports CPU and memory per session.
+ *
+ * --------------------------------------------------------------*/
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <poll.h>
+#include <pty.h>
+#include <sys/wait.h>
+
+#define MAX_STEPS 64
+#define MAX_SESSIONS 1000
+
+typedef struct ldStep ldStep;
+struct ldStep {
+  double secs; // how long the step runs
+  double rate; // keys per second
+  char keys[64]; // sent in turn, round and round
+};
+
+/* the default schedule: ramp asteroids to the cap, missile storms, chest floods */
+ldStep steps[MAX_STEPS] = {
+  {1, 2, " "},
+  {20, 30, "x"},
+  {20, 40, " d"},
+  {10, 30, "c"},
+  {20, 60, " xw a"},
+  {5, 10, "s"},
+};
+int nSteps = 6;
+
+/* -r: spawn a little, quit to the title and start over, again and again */
+ldStep restartSteps[] = {
+  {1, 2, " "},
+  {60, 200, "xxq "},
+};
+
+char* game = "./astervoid";
+char* scriptPath = NULL;
+int duration = 60;
+int cols = 200;
+int rows = 60;
+int nSessions = 0; // 0: one game on a forkpty of its own
+int fds[MAX_SESSIONS]; // pty masters
+int slaves[MAX_SESSIONS];
+int nFds = 0;
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+double cpuSecs(pid_t pid) {
+  // user plus system time, fields 14 and 15 of /proc/pid/stat
+  char path[64], line[1024], *p;
+  unsigned long ut, st;
+  FILE* fp;
+
+  snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+  if ((fp = fopen(path, "r")) == NULL) {
+    return -1;
+  }
+  if (fgets(line, sizeof(line), fp) == NULL || (p = strrchr(line, ')')) == NULL || sscanf(p+2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &ut, &st) != 2) {
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+  return (double)(ut + st) / sysconf(_SC_CLK_TCK);
+}
+
+long rssKb(pid_t pid) {
+  char path[64], line[256];
+  long kb = -1;
+  FILE* fp;
+
+  snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+  if ((fp = fopen(path, "r")) == NULL) {
+    return -1;
+  }
+  while (fgets(line, sizeof(line), fp)) {
+    if (strncmp(line, "VmRSS:", 6) == 0) {
+      kb = atol(line+6);
+    }
+  }
+  fclose(fp);
+  return kb;
+}
+
+int loadScript(char* path) {
+  // one step per line: <seconds> <keys per second> <keys to the end of the line>
+  char line[256];
+  int n = 0, off;
+  FILE* fp;
+
+  if ((fp = fopen(path, "r")) == NULL) {
+    perror(path);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), fp) && n < MAX_STEPS) {
+    line[strcspn(line, "\n")] = '\0';
+    if (line[0] == '#' || line[0] == '\0') {
+      continue;
+    }
+    if (sscanf(line, "%lf %lf %n", &steps[n].secs, &steps[n].rate, &off) < 2 || line[off] == '\0') {
+      fprintf(stderr, "%s: bad step: %s\n", path, line);
+      fclose(fp);
+      return -1;
+    }
+    strncpy(steps[n].keys, line+off, sizeof(steps[n].keys)-1);
+    n++;
+  }
+  fclose(fp);
+  return n;
+}
+
+void drain(double until) {
+  // the game blocks once a pty fills, so keep reading what it draws
+  struct pollfd pfd[nFds];
+  char buf[4096];
+  int ms, i;
+
+  for (i = 0; i < nFds; i++) {
+    pfd[i].fd = fds[i];
+    pfd[i].events = POLLIN;
+  }
+  while ((ms = (int)((until - now())*1000)) > 0) {
+    if (poll(pfd, nFds, ms) <= 0) {
+      continue;
+    }
+    for (i = 0; i < nFds; i++) {
+      if (pfd[i].revents && read(pfd[i].fd, buf, sizeof(buf)) <= 0) {
+	pfd[i].fd = -1; // the game let go of this one
+      }
+    }
+  }
+}
+
+int sendKey(char key) {
+  int i, n = 0;
+
+  for (i = 0; i < nFds; i++) {
+    n += write(fds[i], &key, 1) == 1;
+  }
+  return n;
+}
+
+pid_t spawnSessions(char* statsPath) {
+  // one pty per session, the game gets the slave names
+  struct winsize ws;
+  char* args[nSessions + 5];
+  int i;
+  pid_t pid;
+
+  memset(&ws, 0, sizeof(ws));
+  ws.ws_col = cols;
+  ws.ws_row = rows;
+  args[0] = game;
+  args[1] = "-o";
+  args[2] = statsPath;
+  for (i = 0; i < nSessions; i++) {
+    if (openpty(&fds[i], &slaves[i], NULL, NULL, &ws) < 0) {
+      perror("openpty");
+      exit(1);
+    }
+    args[3+i] = strdup(ttyname(slaves[i]));
+  }
+  args[3+nSessions] = NULL;
+  nFds = nSessions;
+
+  pid = fork();
+  if (pid == 0) {
+    // the game opens the ttys by name; the masters stay ours, so closing
+    // them is a hang up the game sees
+    for (i = 0; i < nSessions; i++) {
+      close(fds[i]);
+      close(slaves[i]);
+    }
+    if (getenv("TERM") == NULL) {
+      setenv("TERM", "xterm", 1);
+    }
+    execv(game, args);
+    perror(game);
+    _exit(127);
+  }
+  return pid;
+}
+
+int main(int argc, char *argv[]) {
+  struct winsize ws;
+  char statsPath[] = "/tmp/astervoid-load.XXXXXX";
+  char line[256];
+  int opt, fd, status, step, k, i;
+  long keys = 0, rss, rss0 = -1, rssPeak = 0;
+  double start, stepEnd, nextKey, nextSample, cpu;
+  pid_t pid;
+  FILE* fp;
+
+  while ((opt = getopt(argc, argv, "d:g:n:rs:x:y:")) != -1) {
+    switch (opt) {
+    case 'd':
+      duration = atoi(optarg);
+      break;
+    case 'g':
+      game = optarg;
+      break;
+    case 'n':
+      nSessions = atoi(optarg);
+      if (nSessions < 1 || nSessions > MAX_SESSIONS) {
+	fprintf(stderr, "%s: 1 to %d sessions\n", argv[0], MAX_SESSIONS);
+	exit(1);
+      }
+      break;
+    case 'r':
+      memcpy(steps, restartSteps, sizeof(restartSteps));
+      nSteps = sizeof(restartSteps)/sizeof(ldStep);
+      break;
+    case 's':
+      scriptPath = optarg;
+      break;
+    case 'x':
+      cols = atoi(optarg);
+      break;
+    case 'y':
+      rows = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-d seconds] [-g game] [-n sessions] [-r] [-s script] [-x cols] [-y rows]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (scriptPath && (nSteps = loadScript(scriptPath)) <= 0) {
+    exit(1);
+  }
+  if ((fd = mkstemp(statsPath)) < 0) {
+    perror("mkstemp");
+    exit(1);
+  }
+  close(fd);
+
+  if (nSessions > 0) {
+    pid = spawnSessions(statsPath);
+  } else {
+    memset(&ws, 0, sizeof(ws));
+    ws.ws_col = cols;
+    ws.ws_row = rows;
+    pid = forkpty(&fd, NULL, NULL, &ws);
+    if (pid == 0) {
+      if (getenv("TERM") == NULL) {
+	setenv("TERM", "xterm", 1);
+      }
+      execl(game, game, "-o", statsPath, (char*)NULL);
+      perror(game);
+      _exit(127);
+    }
+    fds[nFds++] = fd;
+  }
+  if (pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+
+  start = now();
+  nextSample = start;
+  drain(start + 0.5); // let it come up to the title
+  // the game has its ttys open by now; holding the slaves too would keep
+  // them alive after the game lets go, or after we are killed
+  for (i = 0; i < nSessions; i++) {
+    close(slaves[i]);
+  }
+  for (step = 0; now() - start < duration; step = (step + 1) % nSteps) {
+    stepEnd = now() + steps[step].secs;
+    if (stepEnd > start + duration) {
+      stepEnd = start + duration;
+    }
+    nextKey = now();
+    for (k = 0; now() < stepEnd; k++) {
+      keys += sendKey(steps[step].keys[k % strlen(steps[step].keys)]);
+      nextKey += 1.0 / steps[step].rate;
+      if (now() >= nextSample) {
+	rss = rssKb(pid);
+	if (rss0 < 0 && now() - start >= steps[0].secs) {
+	  rss0 = rss; // baseline once the game is running
+	}
+	if (rss > rssPeak) {
+	  rssPeak = rss;
+	}
+	nextSample += 1.0;
+      }
+      drain(nextKey < stepEnd ? nextKey : stepEnd);
+    }
+  }
+  rss = rssKb(pid);
+  cpu = cpuSecs(pid);
+
+  // leave play for the title, then quit from there (or from game over)
+  for (k = 0; k < 10 && waitpid(pid, &status, WNOHANG) == 0; k++) {
+    if (sendKey('q') > 0) {
+      drain(now() + 0.5);
+    }
+  }
+  if (waitpid(pid, &status, WNOHANG) == 0) {
+    kill(pid, SIGTERM);
+    waitpid(pid, &status, 0);
+  }
+  for (i = 0; i < nFds; i++) {
+    close(fds[i]);
+  }
+
+  printf("load: %d s, %d steps, %ld keys, %dx%d terminal\n", duration, nSteps, keys, cols, rows);
+  printf("rss: %ld kB at start, %ld kB at end, %ld kB peak, drift %+ld kB\n", rss0, rss, rssPeak, rss - rss0);
+  if (nSessions > 0) {
+    printf("sessions: %d, %.1f kB rss and %.3f ms cpu/s each\n", nSessions, (double)rss/nSessions, cpu*1e3/duration/nSessions);
+  } else {
+    printf("cpu: %.2f s\n", cpu);
+  }
+  if ((fp = fopen(statsPath, "r")) != NULL) {
+    while (fgets(line, sizeof(line), fp)) {
+      fputs(line, stdout);
+    }
+    fclose(fp);
+  } else {
+    printf("no counters from the game\n");
+  }
+  unlink(statsPath);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+}
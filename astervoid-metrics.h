@@ -0,0 +1,105 @@
+/* ---------------------------------------------------------------
+ *
+ * astervoid-metrics.h
+ *
+ * Copyright (C) 2017-2018, 2021 Matthew Love <matthew.love@colorado.edu>
+ *
+ * This file is liscensed under the GPL v.2 or later and
+ * is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * <http://www.gnu.org/licenses/>
+ *
+ * The live metrics segment a running astervoid publishes and
+ * astervoid-top reads: one shm_open segment per process, named
+ * AV_METRICS_PREFIX and the pid, a header then one record per
+ * session. Every record has a single writer and a seqlock, so
+ * readers never block the game and never see a torn record.
+ *
+ * --------------------------------------------------------------*/
+
+#ifndef ASTERVOID_METRICS_H
+#define ASTERVOID_METRICS_H
+
+#include <string.h>
+#include <stdatomic.h>
+
+#define AV_METRICS_PREFIX "/astervoid."
+#define AV_METRICS_MAGIC 0x41564d53 // "AVMS"
+#define AV_METRICS_VERSION 2 // bump on any layout change
+
+typedef struct avSession avSession;
+struct avSession {
+  atomic_uint seq; // odd while the session is writing
+  int id;
+  int live; // 0 once the player quit or the terminal went away
+  int status; // GAME_*
+  int level;
+  long score;
+  long ticks; // simulation ticks run
+  long frames; // frames drawn
+  long missed; // frame deadlines passed
+  long cpuNs; // CPU time spent running the session
+  long tickNs; // the last tick
+  long sceneNs; // the last frame, split by phase
+  long composeNs;
+  long flushNs;
+  int lAst; // entities in play
+  int lMiss;
+  int lChest;
+  int nUfo;
+  long hits; // collision events
+  long hitsApplied;
+  int pads; // sprite pads allocated
+  long termBytes; // written to the terminal
+  long dropped; // frames replaced before the writer could send them
+  long stallNs; // time the terminal would take no more
+};
+
+typedef struct avMetrics avMetrics;
+struct avMetrics {
+  unsigned int magic;
+  unsigned int version;
+  unsigned int size; // of the whole segment
+  int pid;
+  int nSessions;
+  int fps; // simulation ticks a second
+  int renderFps; // frames a second
+  atomic_uint seq; // for the fields below
+  long rssKb;
+  long started; // time(), when the game came up
+  avSession sessions[];
+};
+
+// the writer brackets its stores; the fences keep them inside the bracket
+static inline void avWriteBegin(atomic_uint* seq) {
+  atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed)+1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+}
+
+static inline void avWriteEnd(atomic_uint* seq) {
+  atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed)+1, memory_order_release);
+}
+
+// the reader copies until it gets a copy no write overlapped; 0 if it gave up
+static inline int avRead(atomic_uint* seq, void* dst, const void* src, size_t n) {
+  unsigned int s0, s1;
+  int tries;
+
+  for (tries = 0; tries < 1000; tries++) {
+    s0 = atomic_load_explicit(seq, memory_order_acquire);
+    if (s0 & 1) {
+      continue;
+    }
+    memcpy(dst, src, n);
+    atomic_thread_fence(memory_order_acquire);
+    s1 = atomic_load_explicit(seq, memory_order_relaxed);
+    if (s0 == s1) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#endif
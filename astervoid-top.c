@@ -0,0 +1,226 @@
+/* ---------------------------------------------------------------
+ *
+ * astervoid-top.c
+ *
+ * Copyright (C) 2017-2018, 2021 Matthew Love <matthew.love@colorado.edu>
+ *
+ * This file is liscensed under the GPL v.2 or later and
+ * is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * <http://www.gnu.org/licenses/>
+ *
+ * Shows every running astervoid's sessions from the metrics
+ * segments they publish (see astervoid-metrics.h), refreshed
+ * every -d seconds, -n times or until interrupted. It only maps
+ * the segments read only and never touches the games' terminals.
+ *
+ * --------------------------------------------------------------*/
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "astervoid-metrics.h"
+
+#define MAX_GAMES 64
+#define MAX_ROWS 4096 // sessions across all games
+
+typedef struct topGame topGame;
+struct topGame {
+  int pid;
+  avMetrics* m; // mapped read only
+  size_t size;
+};
+
+typedef struct topRow topRow;
+struct topRow {
+  int pid;
+  avSession now;
+  avSession then; // at the last refresh, for the rates
+  int seen; // then is good
+};
+
+char* statusNames[5] = {"play", "paused", "over", "title", "reset"};
+
+topGame games[MAX_GAMES];
+int nGames = 0;
+topRow rows[MAX_ROWS];
+int nRows = 0;
+double interval = 1.0;
+int count = 0; // refreshes, 0 for ever
+int clearScreen = 1;
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+void gamesUnmap() {
+  int i;
+
+  for (i = 0; i < nGames; i++) {
+    munmap(games[i].m, games[i].size);
+  }
+  nGames = 0;
+}
+
+void gamesMap() {
+  // every segment whose game is still running; dead games leave theirs behind
+  char name[300];
+  struct dirent* de;
+  struct stat st;
+  avMetrics* m;
+  DIR* dir;
+  int fd, pid;
+
+  gamesUnmap();
+  if ((dir = opendir("/dev/shm")) == NULL) {
+    return;
+  }
+  while ((de = readdir(dir)) != NULL && nGames < MAX_GAMES) {
+    if (strncmp(de->d_name, AV_METRICS_PREFIX + 1, strlen(AV_METRICS_PREFIX) - 1) != 0) {
+      continue;
+    }
+    pid = atoi(de->d_name + strlen(AV_METRICS_PREFIX) - 1);
+    if (kill(pid, 0) < 0 && errno == ESRCH) {
+      continue;
+    }
+    snprintf(name, sizeof(name), "/%s", de->d_name);
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+      continue;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(avMetrics) || (m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+      close(fd);
+      continue;
+    }
+    close(fd);
+    if (m->magic != AV_METRICS_MAGIC || m->version != AV_METRICS_VERSION || m->size > (size_t)st.st_size) {
+      munmap(m, st.st_size);
+      continue;
+    }
+    games[nGames].pid = pid;
+    games[nGames].m = m;
+    games[nGames++].size = st.st_size;
+  }
+  closedir(dir);
+}
+
+topRow* rowFind(int pid, int id) {
+  int i;
+
+  for (i = 0; i < nRows; i++) {
+    if (rows[i].pid == pid && rows[i].now.id == id) {
+      return &rows[i];
+    }
+  }
+  if (nRows == MAX_ROWS) {
+    return NULL;
+  }
+  memset(&rows[nRows], 0, sizeof(topRow));
+  rows[nRows].pid = pid;
+  rows[nRows].now.id = id;
+  return &rows[nRows++];
+}
+
+void refresh(double secs, int show) {
+  // every live session's record; the first pass only sets up the rates
+  avMetrics head;
+  avSession cur;
+  topRow* r;
+  double ticks, kBs, cpu, drops, stall;
+  int g, i, n, live = 0;
+
+  if (show) {
+    if (clearScreen) {
+      printf("\033[H\033[J");
+    }
+    printf("%5s %4s %-6s %5s %7s %6s %6s %6s %6s %6s %4s %4s %4s %3s %7s %4s %9s %6s %10s %8s\n",
+	   "pid", "sess", "status", "level", "score", "tick/s", "tickms", "scene", "comp", "flush", "ast", "mis", "chst", "ufo", "hits", "pads", "term kB/s", "drop/s", "stall ms/s", "cpu ms/s");
+  }
+  for (g = 0; g < nGames; g++) {
+    if (!avRead(&games[g].m->seq, &head, games[g].m, sizeof(avMetrics))) {
+      continue;
+    }
+    // a short or corrupt segment mustn't send us past the mapping
+    n = (games[g].size - sizeof(avMetrics)) / sizeof(avSession);
+    if (head.nSessions < n) {
+      n = head.nSessions < 0 ? 0 : head.nSessions;
+    }
+    for (i = 0; i < n; i++) {
+      if (!avRead(&games[g].m->sessions[i].seq, &cur, &games[g].m->sessions[i], sizeof(avSession)) || !cur.live) {
+	continue;
+      }
+      if ((r = rowFind(games[g].pid, cur.id)) == NULL) {
+	continue;
+      }
+      r->then = r->now;
+      r->now = cur;
+      ticks = kBs = cpu = drops = stall = 0.0;
+      if (r->seen && secs > 0) {
+	ticks = (cur.ticks - r->then.ticks) / secs;
+	kBs = (cur.termBytes - r->then.termBytes) / 1024.0 / secs;
+	drops = (cur.dropped - r->then.dropped) / secs;
+	stall = (cur.stallNs - r->then.stallNs) / 1e6 / secs;
+	cpu = (cur.cpuNs - r->then.cpuNs) / 1e6 / secs;
+      }
+      r->seen = 1;
+      live++;
+      if (show) {
+	printf("%5d %4d %-6s %5d %7ld %6.1f %6.3f %6.3f %6.3f %6.3f %4d %4d %4d %3d %7ld %4d %9.1f %6.1f %10.1f %8.2f\n",
+	       games[g].pid, cur.id, cur.status >= 0 && cur.status < 5 ? statusNames[cur.status] : "?",
+	       cur.level, cur.score, ticks, cur.tickNs/1e6, cur.sceneNs/1e6, cur.composeNs/1e6, cur.flushNs/1e6,
+	       cur.lAst, cur.lMiss, cur.lChest, cur.nUfo, cur.hits, cur.pads, kBs, drops, stall, cpu);
+      }
+    }
+    if (show) {
+      printf("%5d rss %ld kB, %d sessions, up %ld s\n", games[g].pid, head.rssKb, head.nSessions, (long)time(NULL) - head.started);
+    }
+  }
+  if (show) {
+    printf("%d games, %d live sessions\n", nGames, live);
+    fflush(stdout);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  double last, t;
+  int opt, n;
+
+  while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+    switch (opt) {
+    case 'd':
+      interval = atof(optarg);
+      break;
+    case 'n':
+      count = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-d seconds] [-n refreshes]\n", argv[0]);
+      exit(1);
+    }
+  }
+  clearScreen = isatty(1);
+  gamesMap();
+  refresh(0, 0);
+  last = now();
+  for (n = 0; count == 0 || n < count; n++) {
+    usleep(interval*1e6);
+    // a new game shows up, a finished one drops out, at the next refresh
+    gamesMap();
+    t = now();
+    refresh(t - last, 1);
+    last = t;
+  }
+  gamesUnmap();
+  return 0;
+}
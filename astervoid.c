@@ -21,17 +21,107 @@
 #include <sys/time.h>
 #include <time.h>
 #include <signal.h>
+#include <errno.h>
 #include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <termios.h>
+#include "astervoid-metrics.h"
 
 #define _version 0.1.2
 
-#define DELAY 50000
 #define FPS 8
+#define RENDER_FPS 32 // a multiple of FPS
+#define INPUT_RING 64 // power of two
 
 #define MAX_ASTEROIDS 500
-#define MAX_MISSLES 20
+#define MAX_UFOS 32 // the fleet grows a ship a level up to this
+#define MISSLES_BASE 20 // missles in flight with one ufo out
+#define MISSLES_PER_UFO 4 // ... and for every ufo after it
+#define MAX_MISSLES (MISSLES_BASE + MAX_UFOS*MISSLES_PER_UFO)
+#define GRID_COLS 32 // targeting grid over the field, whatever its size
+#define GRID_ROWS 16
 #define MAX_CHESTS 20
 
+#define MISSLE_STEP 1
+
+#define MAX_BLITS (MAX_ASTEROIDS+MAX_MISSLES+MAX_CHESTS+MAX_UFOS+8)
+#define MAX_RENDER_THREADS 32
+#define BAND_MIN_CELLS 65536 // smaller frames are composed on one thread
+#define IDLE_RESIZE_MS 1000 // hosted ttys send no SIGWINCH, so idle checks their size this often
+#define TERM_DRAIN_MS 100 // on the way out, the terminal gets this long to take the rest ...
+#define TERM_DRAIN_TRIES 10 // ... this many times over
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN (1UL << (WHEEL_BITS*WHEEL_LEVELS)) // ticks ahead an event can sit
+
+#define EV_CHEST 0
+#define EV_UFO 1
+#define EV_LEVEL 2
+#define EV_EFFECT 3
+#define EV_MOVE 4 // on the move calendar, not the game's wheel
+
+#define CHEST_CHANCE 0.001 // per tick
+#define UFO_RESPAWN 1 // ticks
+
+#define MAX_HITS 1024 // collision events one tick can hold
+
+#define FIX_SHIFT 8 // gravity velocities and sub-cell positions, in 1/256 cells
+#define FIX_ONE (1 << FIX_SHIFT)
+#define GRAVITY_G 0.02 // cells^3 per mass per tick^2
+#define GRAVITY_SOFT 2.0 // cells; keeps close passes from slingshotting
+#define GRAVITY_RANGE 0.8 // of half the shorter side; pulls stop short of the far side
+#define GRAVITY_VMAX (FIX_ONE/2) // half a cell a tick, so sweeps stay short
+#define GRAVITY_BIG 2.0 // masses: big and small asteroids
+#define GRAVITY_SMALL 1.0
+#define GRAVITY_SHIP 6.0
+#define GRAVITY_UFO 4.0
+#define BH_DEPTH 24 // quadtree levels; bodies closer than that share a leaf
+
+#define HIT_SHIP_UFO 0 // a: ufo
+#define HIT_SHIP_CHEST 1 // b: chest
+#define HIT_UFO_CHEST 2 // a: ufo, b: chest
+#define HIT_SHIP_MISSLE 3 // a: missle
+#define HIT_UFO_MISSLE 4 // a: missle, b: ufo
+#define HIT_AST_MISSLE 5 // a: missle, b: asteroid
+#define HIT_SHIP_AST 6 // b: asteroid
+#define HIT_UFO_AST 7 // a: ufo, b: asteroid
+#define HIT_AST_AST 8 // a, b: asteroids
+
+#define TOUCH_SHIP (1ULL << MAX_UFOS) // astTouch bit for the ship, ufos take the bits below
+
+#define MAX_EFFECTS 32
+#define FX_BONUS 0
+#define FX_BREAK 1
+#define FX_EXPLOSION 2
+#define FX_BONUS_TICKS 4
+#define FX_BREAK_TICKS 1
+#define FX_EXPLOSION_TICKS 2
+
+#define ARENA_SIZE (256*1024) // everything one game allocates
+#define MAX_SHAPES 32 // distinct sprite sizes, one shared pad each
+#define MAX_SPRITES 64 // distinct sprite arts compiled to spans, a hash table
+#define MAX_SPANS 1024 // opaque runs across all of them
+
+#define BLIT_OPAQUE 0 // blanks cover what is underneath: the panels
+#define BLIT_SPRITE 1 // blanks show through, art that never changes, compiled once
+#define BLIT_CLEAR 2 // blanks show through, art rewritten between frames
+
+#define BENCH_W 960
+#define BENCH_H 270
+#define BENCH_FRAMES 100
+#define BENCH_STEPS 5 // gravity steps timed at each size
+#define BENCH_SAMPLE 256 // bodies checked against all pairs
+#define GOLDEN_W "100" // default headless field, LINES and COLUMNS override
+#define GOLDEN_H "30"
+#define GOLDEN_EVERY 32 // frames between printed hashes
+
 #define RED 1
 #define GREEN 2
 #define YELLOW 3
@@ -46,25 +136,36 @@
 #define GAME_TITLE 3
 #define GAME_RESET 4
 
+#define CMD_LEFT 0
+#define CMD_RIGHT 1
+#define CMD_THRUST 2
+#define CMD_BRAKE 3
+#define CMD_FIRE 4
+#define CMD_PAUSE 5
+#define CMD_QUIT 6
+#define CMD_TITLE 7
+#define CMD_CHEST 8
+#define CMD_SPAWN 9
+
 #define SHIP 0
 #define UFO 1
 #define ASTEROID 2
 #define MISSLE 3
 #define CHEST 4
 
-WINDOW *wEmpty;
-WINDOW *wBattleField;
-WINDOW *wStarField;
-WINDOW *wStatus;
-WINDOW *wGameOver;
-WINDOW *wGamePaused;
-WINDOW *wTitleScreen;
-
 time_t t;
 
-int max_y = 0, max_x = 0;
-int scrmax_y = 0, scrmax_x = 0;
-int lAst = 0, lMiss = 0, lChest = 0;
+volatile sig_atomic_t resized = 0;
+volatile sig_atomic_t stopping = 0; // ^Z came in, the frame loop hands the terminal back
+volatile sig_atomic_t repaint = 0; // back from a stop, the screen needs drawing whole
+char* caEnter = NULL; // terminfo's smcup and rmcup, looked up ahead for the stop handler
+char* caExit = NULL;
+int wakeFds[2] = {-1, -1}; // written to get the frame loop out of an idle wait
+long idleWaits = 0; // times the frame loop blocked with nothing to draw
+avMetrics* metrics = NULL; // the live segment astervoid-top reads, if it could be made
+char metricsName[64];
+int writerFds[2] = {-1, -1}; // written to get the writer thread to look for frames
+int statmFd = -1; // /proc/self/statm, for RSS
 
 char* ranks[6]={"Sprite","Novice","Ensign","Captain","Expert","Elite"};
 
@@ -104,6 +205,41 @@ char dAst5[3][5][10] = {
    "  `-~--`  "},
 };
 
+char* dTitle =
+  "  //_\\/ __|_   _| __| _ \\\\ \\ / / _ \\_ _|   \\ "
+  " // _ \\__ \\ | | | _||   / \\ V / (_) | || |) |"
+  "//_/ \\____/ |_| |___|_|_\\  \\_/ \\___/___|___/ ";
+
+char* dGameOver =
+  "                               "
+  "  #####   ####  ##   ## ###### "
+  " ##      ##  ## ####### ##     "
+  " ## ###  ###### ## # ## #####  "
+  " ##  ##  ##  ## ##   ## ##     "
+  "  #####  ##  ## ##   ## ###### "
+  "                               "
+  "  ####  ##   ## ###### ######  "
+  " ##  ## ##   ## ##     ##   ## "
+  " ##  ##  ## ##  #####  ######  "
+  " ##  ##  ## ##  ##     ##  ##  "
+  "  ####    ###   ###### ##   ## "
+  "                               ";
+
+char* dPaused =
+  "###### ###### ##  ##  ##### ###### ##### "
+  "###### ###### ##  ## ###### ###### ######"
+  "##  ## ##  ## ##  ## ##     ##     ##  ##"
+  "##  ## ##  ## ##  ## ##     ##     ##  ##"
+  "###### ###### ##  ## ###### ###### ##  ##"
+  "###### ###### ##  ## ###### ###### ##  ##"
+  "##     ##  ## ##  ##     ## ##     ##  ##"
+  "##     ##  ## ##  ##     ## ##     ##  ##"
+  "##     ##  ## ###### ###### ###### ######"
+  "##     ##  ## ###### #####  ###### ##### ";
+
+char* dStart = "Press SPACE to start";
+char* dRestart = "Press SPACE to restart";
+
 typedef struct gStats gStats;
 struct gStats {
   int astSpeed;
@@ -114,14 +250,16 @@ struct gStats {
   int status;
 };
 
-gStats stats;
-
 typedef struct spOb spOb;
 struct spOb {
   int type; // type of space object; 0-4
   int subtype; // varies by obj // missles(0/1) asteroids(0/1)
   int x; // current ob x
   int y; // current ob y
+  int px; // ob x before the last move step
+  int py; // ob y before the last move step
+  int lx; // ob x it last moved from, for drawing between ticks
+  int ly; // ob y it last moved from, for drawing between ticks
   int max_x; // current ob max_x
   int min_x; // current ob min_x (same as x)
   int max_y; // current ob max_y
@@ -139,13 +277,341 @@ struct spOb {
   int lives; // number of lives
   char* dOb; // space object char
   WINDOW *spWin; // space object window
+  int vx; // gravity mode: velocity, FIX_ONE is a cell a tick
+  int vy;
+  int fx; // ... and how far into its cell the ob has got
+  int fy;
+  int slot; // asteroids: where the id raster keeps it, -1 until it is painted
+  int mv; // asteroids: its move event in gs->astMoves, which stays put as the array shifts
+  unsigned long moved; // asteroids: the calendar tick it last moved on
+};
+
+typedef struct bhBody bhBody;
+struct bhBody {
+  double x; // where its mass sits, cells
+  double y;
+  double m;
+};
+
+typedef struct bhNode bhNode;
+struct bhNode {
+  double x0, y0, size; // the square it covers
+  double cx, cy, m; // centre of mass and total mass
+  double lx, ly, hx, hy; // box round its bodies
+  int child; // first of four, -1 for a leaf
+  int body; // a leaf's one body, -1 when empty or when several share it
+};
+
+typedef struct bhTree bhTree;
+struct bhTree {
+  bhNode* nodes;
+  int n;
+  int cap;
+  double w, h; // the torus the bodies live on
+  double range; // how far a pull reaches
+  long opened; // nodes looked into by bhForce
+  long used; // nodes whose pull was taken whole
+};
+
+typedef struct inCmd inCmd;
+struct inCmd {
+  int cmd; // CMD_*
+  struct timespec ts; // when the key was read
+};
+
+typedef struct inRing inRing;
+struct inRing {
+  inCmd cmds[INPUT_RING];
+  atomic_uint head; // next slot to fill, written by the input thread only
+  atomic_uint tail; // next slot to drain, written by the simulation only
+};
+
+pthread_t inputThread;
+pthread_t writerThread;
+
+typedef struct spSpan spSpan;
+struct spSpan {
+  short r; // row in the art
+  short c; // first column
+  short n; // glyphs in the run
+};
+
+typedef struct spSprite spSprite;
+struct spSprite {
+  char* art; // the key: art, stride and the rectangle drawn
+  int stride;
+  int w;
+  int h;
+  int first; // its runs in the span pool
+  int n;
+  int cells; // glyphs over all its runs
+};
+
+typedef struct blit blit;
+struct blit {
+  int x; // destination column
+  int y; // destination row
+  int w; // columns copied
+  int h; // rows copied
+  int stride; // row length of the art
+  char* art; // glyphs, row major
+  int len; // glyphs in art; the rest of the rectangle is blank
+  chtype attr; // attribute the glyphs are drawn with
+  int mode; // BLIT_*
+  spSprite* sprite; // the runs to draw, for a compiled BLIT_SPRITE
+  WINDOW* pad; // the same art in a pad, for the copywin path
+};
+
+typedef struct frameBuf frameBuf;
+struct frameBuf {
+  int w; // columns
+  int h; // rows
+  chtype* bg; // the empty starfield
+  chtype* cells; // the composed frame
+  blit* blits; // display list, drawn in order
+  int nblits;
+  int cap; // display list capacity
+  int nbands; // horizontal bands the frame is split into
+  int bandRows; // rows per band
+  int* bins; // per band display list indexes, cap each
+  int* nbin; // per band bin lengths
+  spSprite* sprites; // compiled sprites, hashed on the art
+  spSpan* spans;
+  int nSprites;
+  int nSpans;
+  long cellsWritten; // cells the blits have touched
+  long cellsRect; // ... had they been drawn as whole rectangles
+};
+
+frameBuf* renderJob;
+int renderThreads = 1; // bands a large frame is composed in
+int renderPool = 0; // band workers started
+int renderCurses = 0; // compose with copywin instead of the cell buffer
+int gravity = 0; // asteroids pull on each other and are pulled by the ship and ufos
+double gravityTheta = 0.5; // Barnes-Hut opening angle; 0 is exact and n^2
+int benchmark = 0;
+long golden = 0; // headless frames to render through both backends
+unsigned int goldenSeed = 1;
+char* goldenKeys = " xw d  a c sx  "; // one per tick, round and round
+pthread_t renderWorkers[MAX_RENDER_THREADS];
+pthread_barrier_t renderStart;
+pthread_barrier_t renderDone;
+
+typedef struct tmEvent tmEvent;
+struct tmEvent {
+  int kind; // EV_*
+  int arg; // depends on kind
+  int level; // wheel level it is linked on
+  unsigned long due; // tick it fires on
+  tmEvent* next; // NULL when not scheduled
+  tmEvent* prev;
+};
+
+typedef struct tmWheel tmWheel;
+struct tmWheel {
+  unsigned long now; // ticks advanced
+  tmEvent slots[WHEEL_LEVELS][WHEEL_SLOTS]; // list heads
+  int pending[WHEEL_LEVELS]; // events linked per level
+  long scheduled;
+  long cancelled;
+  long fired;
+  long cascaded; // moves down a level
+};
+
+typedef struct fxOb fxOb;
+struct fxOb {
+  int kind; // FX_*, -1 when the slot is free
+  int x;
+  int y;
+  int w;
+  int h;
+  char* art; // what a bonus or break shows
+  char* alt; // a break alternates art and alt
+  char buf[64]; // explosion glyphs, rolled every frame
+  long start; // render frame it started on
+  unsigned int seed; // explosion rand_r state
+  WINDOW* pad; // for the copywin path
+  tmEvent ev; // expiry
+};
+
+typedef struct hitEvent hitEvent;
+struct hitEvent {
+  unsigned char kind; // HIT_*
+  short a; // ob indexes, by kind
+  short b;
+  unsigned int tick; // wheel tick it was seen on
 };
 
-spOb ship;
-spOb ufo;
-spOb asts[MAX_ASTEROIDS];
-spOb chests[MAX_CHESTS];
-spOb missles[MAX_MISSLES];
+typedef struct rasterNode rasterNode;
+struct rasterNode {
+  short id; // asteroid slot
+  int next; // the next node on the same cell, or free node; -1 at the end
+};
+
+typedef struct rasterBox rasterBox;
+struct rasterBox {
+  int x, y, xx, yy; // an asteroid's box as it was painted
+};
+
+typedef struct astPair astPair;
+struct astPair {
+  short a, b; // two asteroids touching, a before b
+};
+
+typedef struct gArena gArena;
+struct gArena {
+  char* base;
+  size_t size;
+  size_t used; // carved since the last reset
+  size_t high; // most ever carved
+  long resets; // games started
+};
+
+typedef struct spShape spShape;
+struct spShape {
+  int h;
+  int w;
+  WINDOW* pad;
+};
+
+typedef struct gInstr gInstr;
+struct gInstr {
+  long frames; // frames drawn
+  long ticks; // simulation ticks run
+  long missed; // frame deadlines passed while still working
+  long frameNs; // total time spent in frames
+  long worstFrame; // longest frame, tick included, ns
+  long worstTick; // longest simulation tick, ns
+  long hits; // collision events detected
+  long hitsApplied; // ... that changed something
+  long hitsDropped; // ... that did not fit the buffer
+  long aims; // ufos aimed at an asteroid
+  long aimScans; // asteroids looked at while aiming
+  long aimGrids; // targeting grids built, one a tick at most
+  long idleFrames; // frames not drawn, nothing on screen had changed
+  long rasterCells; // asteroid cells painted into the id raster
+  long rasterTests; // box tests the raster lookups left to do
+  long scanTests; // ... and the tests a scan of every asteroid would have done
+  long astSeen; // asteroids in play, summed over ticks
+  long astMoved; // ... of them that changed cells, so were painted and looked around
+  long pairsKept; // touching asteroid pairs carried over from the tick before
+  long astSteps; // asteroid moves the calendar made
+  long astSettled; // ... and asteroids looked at the tick after one, all it does between
+  long tickNs; // the last tick
+  long sceneNs; // the last frame: laying out the display list
+  long composeNs; // ... composing the cells
+  long flushNs; // ... and handing them to the writer
+  long termBytes; // written to the terminal
+  long framesSent; // frames the writer got to the terminal
+  long framesDropped; // ... and those a newer one replaced before it could
+  long stalls; // times the terminal stopped taking bytes
+  long stallNs; // ... for this long all told
+  long worstStall;
+};
+
+int instrument = 0; // dump the counters on the way out
+char* instrPath = NULL; // ... into this file rather than stderr
+
+/* everything one game owns; the sprite art and tables above are shared */
+typedef struct gSession gSession;
+struct gSession {
+  int id;
+  int fd; // keys are read from here
+  int tty; // frames go here, written by the writer thread only and never blocking
+  FILE* out; // curses draws into this file, the writer sends it on
+  FILE* in;
+  long outSent; // how much of out the terminal has taken
+  atomic_int framePending; // a frame is staged in curses for the writer
+  atomic_long stallSince; // when the terminal stopped taking bytes, monotonic ns, 0 if it has not
+  struct termios ttyModes; // as found, put back once the session is over
+  struct termios ttyPlay; // ... and as the game has them
+  int ttyRaw; // ttyModes needs putting back
+  SCREEN* screen;
+  int live; // cleared once the player quits
+  atomic_int hangup; // the terminal went away, set by the input thread
+  long cpuNs; // CPU time spent running this session
+  double alpha; // how far the last frame got between ticks
+  int shown; // the status last drawn, -1 to draw whatever it is
+
+  WINDOW *wEmpty;
+  WINDOW *wBattleField;
+  WINDOW *wStarField;
+  WINDOW *wStatus;
+  WINDOW *wGameOver;
+  WINDOW *wGamePaused;
+  WINDOW *wTitleScreen;
+  WINDOW *wTitleText;
+  WINDOW *wStartText;
+  WINDOW *wRestartText;
+  spShape shapes[MAX_SHAPES];
+  int nShapes;
+
+  int max_y, max_x;
+  int scrmax_y, scrmax_x;
+  int lAst, lMiss, lChest;
+  char strStatus[70];
+  gStats stats;
+  inRing input;
+  frameBuf frame;
+  long renderFrames;
+  tmWheel wheel;
+  tmEvent chestEvent;
+  tmEvent* ufoEvents; // respawn, one per fleet slot
+  tmEvent levelEvent;
+  gArena arena;
+  fxOb* effects;
+  hitEvent* hits; // this tick's collisions, resolved after the scan
+  int nHits;
+  gInstr perf;
+
+  spOb ship;
+  spOb* ufos; // the fleet
+  int nUfo; // fleet slots in use, dead or alive
+  int ufoScore; // the fleet's, all together
+  int* gridStart; // asteroid indexes in gridItems by cell, GRID_COLS*GRID_ROWS+1
+  short* gridItems;
+  short* rasterId; // per cell, the first asteroid slot covering it plus one, 0 for none
+  int* rasterMore; // per cell, any others as a chain in rasterNodes, -1 for none
+  rasterNode* rasterNodes;
+  int nRasterNodes, capRasterNodes;
+  int rasterFreeNode; // unlinked nodes, chained through next
+  int rasterW, rasterH; // the field the raster was painted for, 0 to start over
+  rasterBox* slotBox; // per slot, what is painted for it
+  short* slotAst; // ... the asteroid holding it this tick, -1 for none
+  unsigned char* slotLive; // ... whether it is painted
+  short* slotFree;
+  int nSlotFree;
+  unsigned char* astMoved; // per asteroid, it changed cells this tick
+  astPair* pairs; // asteroids touching last tick, by slot
+  int nPairs; // -1 when there were too many to keep
+  astPair* pairsNow; // ... and this tick, by index
+  int rasterSx, rasterSy; // the farthest an asteroid moved this tick, by axis
+  unsigned int rasterStamp; // marks the asteroids one lookup has found
+  unsigned int* astStamp;
+  short* rasterCand; // what the lookup found, ascending
+  int nRasterCand;
+  unsigned long long* astTouch; // ufos (by bit) and the ship touching each asteroid
+  bhTree tree; // gravity mode, rebuilt every tick
+  bhBody* bodies;
+  short* bodyAst; // the asteroid behind each body
+  tmWheel* moves; // the move calendar: asteroids by the tick they next move on
+  tmEvent* astMoves; // per handle, its asteroid's next move
+  short* moveAst; // ... the asteroid holding it, -1 for none
+  short* moveFree;
+  int nMoveFree;
+  short* moveSettle; // handles that moved last tick, their px and py still behind
+  int nMoveSettle;
+  spOb* asts;
+  spOb* chests;
+  spOb* missles;
+};
+
+gSession* sessions;
+int nSessions = 0;
+int serving = 0; // hosting sessions on the ttys named on the command line
+__thread gSession* gs; // the session this thread is running
+pthread_mutex_t cursesLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t writerLock = PTHREAD_MUTEX_INITIALIZER; // a session's tty and outSent
 
 int mod (int a, int b) {
   if (b < 0) {
@@ -158,718 +624,2724 @@ int mod (int a, int b) {
   return ret;
 }
 
-void displayOnBattleField(WINDOW *wElem, int x, int y, int xx, int yy) {
-  copywin(wElem, wBattleField, 0, 0, y, x, yy, xx, 0);
-  wrefresh(wBattleField);
+/* game arena */
+
+void arenaInit(gArena* a, size_t size) {
+  a->base = malloc(size);
+  a->size = size;
+  a->used = 0;
+  a->high = 0;
+  a->resets = 0;
 }
 
-void clearFromBattleField(int x, int y, int xx, int yy) {
-  copywin(wEmpty, wBattleField, y, x, y, x, yy, xx, 0);
+void arenaReset(gArena* a) {
+  a->used = 0;
+  a->resets++;
 }
 
-void bonusDisplay(int x, int y, int width, int height, char* db){
-  WINDOW* wShipBonus;
-  int t;
+void* arenaAlloc(gArena* a, size_t n) {
+  void* p;
 
-  wShipBonus=newpad(height,width);
-  for(t=0;t<10;t++){ 			// 5 frames
-    wattrset(wShipBonus,COLOR_PAIR(mod(t,6)));	// set color
-    wclear(wShipBonus);	// clear pad
-    waddstr(wShipBonus, db);
-    displayOnBattleField(wShipBonus,x,y,x+width-1,y+height-1);
-    usleep(50000);		// play animation not too fast
+  n = (n + 15) & ~(size_t)15;
+  if (a->base == NULL || a->used + n > a->size) {
+    endwin();
+    fprintf(stderr, "astervoid: game arena exhausted (%zu of %zu bytes)\n", a->used + n, a->size);
+    exit(1);
   }
-}
-
-void breakDisplay(int nAst){
-  WINDOW* wAstBreak;
-  int t;
-
-  wAstBreak=newpad(5,7);
-  for(t=0;t<10;t++){
-    wattrset(wAstBreak,COLOR_PAIR(mod(t,6)));
-    wclear(wAstBreak);
-    if (t % 2 == 0) {
-      waddstr(wAstBreak, asts[nAst].dOb);
-    } else {
-      waddstr(wAstBreak, dAst2[0][0]);
-    }
-    displayOnBattleField(wAstBreak,asts[nAst].x,asts[nAst].y,asts[nAst].max_x,asts[nAst].max_y);
-    usleep(5000);
+  p = a->base + a->used;
+  a->used += n;
+  if (a->used > a->high) {
+    a->high = a->used;
   }
+  memset(p, 0, n);
+  return p;
 }
 
-void explosionDisplay(int x, int y, int width, int height) {
-  WINDOW* wShipExplosion;
-  char explosionChars[18+1]="@~`.,^#*-_=\\/%{}  ";
-  int t,s,r;
-  
-  wShipExplosion=newpad(height,width);
-  for(t=0;t<6;t++){
-    wclear(wShipExplosion);
-    wattrset(wShipExplosion,COLOR_PAIR(mod(t,6)));
-    for(s=0;s<width;s++){
-      for(r=0;r<height;r++){
-    	waddch(wShipExplosion,explosionChars[rand()%18]);
-      }
-    }
-    displayOnBattleField(wShipExplosion,x,y,x+width-1,y+height-1);
-    //usleep(50000);
-    usleep(10000);
-  }
-} // todo: kann man bestimmt noch besser machen.
+/* curses */
 
-/* collisions */
+void cursesEnter() {
+  // curses keeps the current screen and its window list in globals, so
+  // anything that creates windows or writes the terminal goes one at a time
+  pthread_mutex_lock(&cursesLock);
+  set_term(gs->screen);
+}
 
-int collisionP(int sx, int sy, int sxx, int syy, int tx, int ty, int txx, int tyy) {
+void cursesLeave() {
+  pthread_mutex_unlock(&cursesLock);
+}
 
-  if ((sy >= ty && sy <= tyy) || syy >= ty && syy <= tyy) {
-    if ((sx >= tx && sx <= txx) || sxx >= tx && sxx <= txx) {
-      return 1;
-    }
+long procField(int fd, char* name) {
+  // a number out of a /proc file kept open, 0 if it is not there
+  char buf[512], *p;
+  int n;
+
+  if (fd < 0 || (n = pread(fd, buf, sizeof(buf)-1, 0)) <= 0) {
+    return 0;
   }
-  return 0;
+  buf[n] = '\0';
+  if ((p = strstr(buf, name)) == NULL) {
+    return 0;
+  }
+  return atol(p + strlen(name));
 }
 
-int spObCollision(spOb* st0, spOb* st1) {
-  return collisionP(st0->x,st0->y,st0->max_x,st0->max_y,st1->x,st1->y,st1->max_x,st1->max_y);
-}
+void writerWake() {
+  char c = 0;
 
-void collisionMonitor() {
-  int i, j;
-  
-  // ship and ufo collide
-  if (spObCollision(&ship, &ufo)) {
-    explosionDisplay(ship.x,ship.y,2,1);
-    ship.lives-=1;
-    stats.status = GAME_RESET;
+  if (write(writerFds[1], &c, 1) < 0) {
+    return; // a full pipe is already a wake up
   }
+}
 
-  // ship and chest collide
-  for (i = 0; i < lChest; i++) {
-    if (spObCollision(&ship, &chests[i])) {
-      bonusDisplay(ship.x,ship.y,2,1,ship.dOb);
-      ship.score+=10;
-      ship.lives+=1;
-      chests[i].draw=0;
-    } else if (spObCollision(&ufo, &chests[i])) {
-      bonusDisplay(ufo.x,ufo.y,5,1,ufo.dOb);
-      ufo.score+=10;
-      chests[i].draw=0;
-    }
+void frameHandOff() {
+  // the frame is staged in curses for the writer thread; one it has not got
+  // to yet is simply replaced, and the next doupdate sends only the newest
+  if (atomic_exchange(&gs->framePending, 1)) {
+    gs->perf.framesDropped++;
   }
+  writerWake();
+}
 
-  // missle hits something
-  for (i = 0; i < lMiss; i++) {
-    if (missles[i].subtype == 1) {
-      if (spObCollision(&missles[i],&ship)) {
-	explosionDisplay(ship.x,ship.y,2,1);
-	ship.lives-=1;
-	stats.status = GAME_RESET;
-      }
-    } else if (missles[i].subtype == 0) {
-      if (spObCollision(&missles[i],&ufo)) {
-	explosionDisplay(ufo.x,ufo.y,5,1);
-	ufo.draw = 0;
-	missles[i].draw = 0;
-	ship.score+=2;
-      }
-    }
-    for (j = 0; j < lAst; j++) {
-      if (spObCollision(&missles[i],&asts[j])) {
-	breakDisplay(j);
-	asts[j].draw = 0;
-	if (missles[i].subtype == 1) {
-	  ufo.score+=1;
-	} else {
-	  ship.score+=1;
-	}
-	missles[i].draw = 0;
-	
-      }
+WINDOW* shapePad(int h, int w) {
+  // one pad per sprite size, shared; the copywin path fills it per blit
+  WINDOW* pad;
+  int i;
+
+  for (i = 0; i < gs->nShapes; i++) {
+    if (gs->shapes[i].h == h && gs->shapes[i].w == w) {
+      return gs->shapes[i].pad;
     }
   }
-  
-  // asteroid hits something
-  for (i = 0; i <= lAst; i++) {
-    if (spObCollision(&ship, &asts[i])) {
-      explosionDisplay(ship.x,ship.y,2,1);
-      ship.lives-=1;
-      asts[i].draw = 0;
-      stats.status = GAME_RESET;
-    }
-    if (spObCollision(&ufo, &asts[i])) {
-      explosionDisplay(ufo.x,ufo.y,5,1);
-      ufo.draw = 0;
-    }
-    for (j = 0; j <= lAst; j++) {
-      if (j != i) {
-	if (spObCollision(&asts[i], &asts[j])) {
-	    asts[i].draw = 0;
-	    asts[j].draw = 0;
-	}
-      }
-    }
+  if (gs->nShapes == MAX_SHAPES) {
+    // an untracked pad would never be freed, and one a spawn adds up
+    cursesEnter();
+    endwin();
+    fprintf(stderr, "astervoid: more than %d sprite sizes\n", MAX_SHAPES);
+    exit(1);
   }
+  cursesEnter();
+  pad = newpad(h, w);
+  cursesLeave();
+  gs->shapes[gs->nShapes].h = h;
+  gs->shapes[gs->nShapes].w = w;
+  gs->shapes[gs->nShapes++].pad = pad;
+  return pad;
 }
 
-void spObOnBattleField(spOb* spaceThing) {
-  copywin(spaceThing->spWin, wBattleField, 0, 0, spaceThing->y, spaceThing->x, spaceThing->max_y, spaceThing->max_x, 0);
-  wrefresh(wBattleField);
+/* frame composition */
+
+void frameFree(frameBuf* f) {
+  free(f->bg);
+  free(f->cells);
+  free(f->blits);
+  free(f->bins);
+  free(f->nbin);
+  free(f->sprites);
+  free(f->spans);
+  f->bg = f->cells = NULL;
+  f->blits = NULL;
+  f->bins = f->nbin = NULL;
+  f->sprites = NULL;
+  f->spans = NULL;
+  f->nSprites = f->nSpans = f->nblits = 0;
 }
 
-void spObFromBattleField(spOb* spaceThing) {
-  copywin(wEmpty, wBattleField, spaceThing->y, spaceThing->x, spaceThing->y, spaceThing->x, spaceThing->max_y, spaceThing->max_x, 0);
+void frameInit(frameBuf* f, int w, int h, int cap) {
+  frameFree(f);
+  f->w = w;
+  f->h = h;
+  f->cap = cap;
+  f->bg = calloc(w*h, sizeof(chtype));
+  f->cells = calloc(w*h, sizeof(chtype));
+  f->blits = calloc(cap, sizeof(blit));
+  f->bins = calloc(MAX_RENDER_THREADS*cap, sizeof(int));
+  f->nbin = calloc(MAX_RENDER_THREADS, sizeof(int));
+  f->sprites = calloc(MAX_SPRITES, sizeof(spSprite));
+  f->spans = calloc(MAX_SPANS, sizeof(spSpan));
+  f->nSprites = 0;
+  f->nSpans = 0;
+  f->nblits = 0;
+  f->nbands = 1;
+  f->bandRows = h;
 }
 
-void spObRefresh(spOb* spaceThing) {
-  wclear(spaceThing->spWin);
-  wattrset(spaceThing->spWin,COLOR_PAIR(spaceThing->color));
-  waddstr(spaceThing->spWin, spaceThing->dOb);
-}
+void readCells(WINDOW* wElem, chtype* cells, int w, int h) {
+  int y;
+  chtype row[w+1]; // winchnstr terminates the row
 
-int spObVoid(spOb* spaceThing) {
-  if (spaceThing->x >= max_x || spaceThing->x <= 0 || spaceThing->y >= max_y || spaceThing->y <= 0) {
-    return 1;
+  for (y = 0; y < h; y++) {
+    mvwinchnstr(wElem, y, 0, row, w);
+    memcpy(cells + y*w, row, w*sizeof(chtype));
   }
-  return 0;
 }
 
-void asteroidRemove(int nAst) {
-  int j, i;
-  spObFromBattleField(&asts[nAst]);
-  for (i = nAst; i < lAst; i++) {
-    asts[i] = asts[i+1];
-  }
-  lAst--;
+void frameBackground(frameBuf* f, WINDOW* wElem) {
+  readCells(wElem, f->bg, f->w, f->h);
 }
 
-void missleRemove(int nMiss) {
-  int i;
-  spObFromBattleField(&missles[nMiss]);
-  for (i = nMiss; i < lMiss; i++) {
-    missles[i] = missles[i+1];
-    missles[i].iter=i;
+void frameBegin(frameBuf* f) {
+  f->nblits = 0;
+}
+
+int artGlyph(char* art, int len, int i) {
+  // what shows at art[i]: the pad holds plain blanks past the art
+  return i < len && art[i] != ' ';
+}
+
+spSprite* spriteCompile(frameBuf* f, char* art, int stride, int w, int h, int len) {
+  // the art's opaque runs, row by row, found once and kept; NULL when
+  // the tables are full and the blit has to look at every cell
+  unsigned long k = ((unsigned long)art/sizeof(char*) + stride*31 + w*17 + h) % MAX_SPRITES;
+  spSprite* sp;
+  int i, r, c, c0, probe;
+
+  for (probe = 0; probe < MAX_SPRITES; probe++, k = (k+1) % MAX_SPRITES) {
+    sp = &f->sprites[k];
+    if (sp->art == NULL) {
+      break;
+    }
+    if (sp->art == art && sp->stride == stride && sp->w == w && sp->h == h) {
+      return sp;
+    }
+  }
+  if (probe == MAX_SPRITES || f->nSprites == MAX_SPRITES-1 || f->nSpans + h*((w+1)/2) > MAX_SPANS) {
+    return NULL;
   }
-  lMiss--;
+  sp->first = f->nSpans;
+  sp->cells = 0;
+  for (r = 0; r < h; r++) {
+    for (c = 0; c < w; c++) {
+      if (!artGlyph(art, len, r*stride + c)) {
+	continue;
+      }
+      for (c0 = c; c < w && artGlyph(art, len, r*stride + c); c++) {
+      }
+      i = f->nSpans++;
+      f->spans[i].r = r;
+      f->spans[i].c = c0;
+      f->spans[i].n = c - c0;
+      sp->cells += c - c0;
+    }
+  }
+  sp->n = f->nSpans - sp->first;
+  sp->art = art;
+  sp->stride = stride;
+  sp->w = w;
+  sp->h = h;
+  f->nSprites++;
+  return sp;
 }
 
-void chestRemove(int nChest) {
+void frameBlit(frameBuf* f, int x, int y, int w, int h, int stride, char* art, chtype attr, int mode, WINDOW* pad) {
+  blit* b;
   int i;
-  spObFromBattleField(&chests[nChest]);
-  for (i = nChest; i < lChest; i++) {
-    chests[i] = chests[i+1];
+
+  // copywin refuses anything hanging off the edge, so do the same
+  if (x < 0 || y < 0 || x+w > f->w || y+h > f->h || f->nblits == f->cap) {
+    return;
+  }
+  b = &f->blits[f->nblits++];
+  b->x = x;
+  b->y = y;
+  b->w = w;
+  b->h = h;
+  b->stride = stride;
+  b->art = art;
+  b->len = strnlen(art, stride*h);
+  b->attr = attr;
+  b->mode = mode;
+  b->sprite = mode == BLIT_SPRITE ? spriteCompile(f, art, stride, w, h, b->len) : NULL;
+  b->pad = pad;
+
+  if (b->mode == BLIT_OPAQUE) {
+    f->cellsWritten += w*h;
+  } else if (b->sprite) {
+    f->cellsWritten += b->sprite->cells;
+  } else {
+    for (i = 0; i < w*h; i++) {
+      f->cellsWritten += artGlyph(art, b->len, i/w*stride + i%w);
+    }
   }
-  lChest--;
+  f->cellsRect += w*h;
 }
 
-void spObMove(spOb* spaceThing) {
-  
-  spObFromBattleField(spaceThing);
-  spObRefresh(spaceThing);
-  spaceThing->mvcnt++;
-  
-  if ((spaceThing->mvcnt % spaceThing->speed) == 0) {  
-    spaceThing->x = mod((spaceThing->x+spaceThing->dx), max_x);
-    spaceThing->y = mod((spaceThing->y+spaceThing->dy), max_y);
-    spaceThing->min_x = mod((spaceThing->min_x+spaceThing->dx), max_x);
-    spaceThing->min_y = mod((spaceThing->min_y+spaceThing->dy), max_y);
-    spaceThing->max_x = mod((spaceThing->max_x+spaceThing->dx), max_x);
-    spaceThing->max_y = mod((spaceThing->max_y+spaceThing->dy), max_y);
+void blitCells(frameBuf* f, blit* b, int y0, int y1) {
+  // a pad filled by waddstr holds the art with attr, then plain blanks
+  int r, c, i, k;
+  spSpan* sp;
+  chtype* row;
+
+  if (b->sprite) {
+    // only the runs that carry glyphs, the blanks between are never touched
+    for (k = 0; k < b->sprite->n; k++) {
+      sp = &f->spans[b->sprite->first + k];
+      if (b->y+sp->r < y0 || b->y+sp->r >= y1) {
+	continue;
+      }
+      row = f->cells + (b->y+sp->r)*f->w + b->x;
+      i = sp->r*b->stride;
+      for (c = sp->c; c < sp->c+sp->n; c++) {
+	row[c] = (unsigned char)b->art[i+c] | b->attr;
+      }
+    }
+    return;
   }
-
-  if (spaceThing->type == MISSLE) {
-    if (spObVoid(spaceThing)==1) {
-      missleRemove(spaceThing->iter);
+  for (r = (b->y < y0 ? y0 - b->y : 0); r < b->h && b->y+r < y1; r++) {
+    row = f->cells + (b->y+r)*f->w + b->x;
+    for (c = 0; c < b->w; c++) {
+      i = r*b->stride + c;
+      if (b->mode == BLIT_OPAQUE) {
+	row[c] = i < b->len ? ((unsigned char)b->art[i] | b->attr) : ' ';
+      } else if (artGlyph(b->art, b->len, i)) {
+	row[c] = (unsigned char)b->art[i] | b->attr;
+      }
     }
   }
-  
-  spObOnBattleField(spaceThing);
 }
 
-/*
- * Initialize Spacebound Objects
- */
+void frameBin(frameBuf* f, int nbands) {
+  int i, k, k0, k1;
 
-static void shipInit() {
-  ship.type = SHIP;
-  ship.iter = 0;
-  ship.mvcnt = 0;
-  ship.dx = -1;
-  ship.dy = 0;
-  ship.dS = 0;
-  ship.x = max_x/2;
-  ship.y = max_y/2;
-  ship.max_x = ship.x+1;
-  ship.min_x = ship.x;
-  ship.max_y = ship.y;
-  ship.min_y = ship.y;
-  ship.drift = 0;
-  ship.speed = 3;
-  ship.color = CYAN;
-  ship.score = 0;
-  ship.lives = 3;
-  ship.dOb = dShips[0];
-  ship.spWin = newpad(1, 2);
-  wattrset(ship.spWin,COLOR_PAIR(ship.color));
-  wclear(ship.spWin);
-}
-
-static void ufoInit() {
-  ufo.type = UFO;
-  ufo.iter = 0;
-  ufo.mvcnt = 0;
-  ufo.speed = stats.ufoSpeed;
-  if ((random() % 2) == 0) {
-    ufo.color = RED;
-  } else {
-    ufo.color = GREEN;
+  f->nbands = nbands;
+  f->bandRows = (f->h + nbands - 1) / nbands;
+  for (k = 0; k < nbands; k++) {
+    f->nbin[k] = 0;
+  }
+  // bins keep display list order, so overlaps resolve as they would serially
+  for (i = 0; i < f->nblits; i++) {
+    k0 = f->blits[i].y / f->bandRows;
+    k1 = (f->blits[i].y + f->blits[i].h - 1) / f->bandRows;
+    for (k = k0; k <= k1; k++) {
+      f->bins[k*f->cap + f->nbin[k]++] = i;
+    }
   }
-  //ufo.score = 0;
-  ufo.lives = 3;
-  ufo.dy = 0;
-  if ((random() % 2) == 0) {
-    ufo.x = max_x-4;
-    ufo.dx = -1;
-  } else {
-    ufo.x = 1;
-    ufo.dx = 1;
-  }
-  ufo.y = (random() % max_y-1)+3;
-  ufo.max_x = ufo.x+5;
-  ufo.min_x = ufo.x;
-  ufo.max_y = ufo.y;
-  ufo.min_y = ufo.y;
-  ufo.draw = 1;
-  ufo.dOb = dUfo[0];
-  
-  ufo.spWin = newpad(1, ufo.max_x-ufo.min_x);
-  wclear(ufo.spWin);
-  wattrset(ufo.spWin, COLOR_PAIR(MAGENTA));
 }
 
-static void asteroidInit(int nAst) {
-  
-  asts[nAst].type = ASTEROID;
-  asts[nAst].iter = nAst;
-  asts[nAst].mvcnt = 0;
-  asts[nAst].speed = stats.astSpeed;
-  asts[nAst].subtype = 5;
-  asts[nAst].draw = 1;
-  int tmp = 0;
-  tmp = (random() % 5);
+void frameBand(frameBuf* f, int band) {
+  int i, y0, y1;
 
-  if (tmp == 4) {
-    asts[nAst].x = (random() % max_x-4)+1;
-    asts[nAst].y = 2;
-    asts[nAst].dy = 1;
-    asts[nAst].dx = -1;
-  } else if (tmp == 3) {
-    asts[nAst].x = 2;
-    asts[nAst].y = (random() % max_y-4)+1;
-    asts[nAst].dx = 1;
-    asts[nAst].dy = -1;
-  } else if (tmp == 2) {
-    asts[nAst].x = max_x-4;
-    asts[nAst].y = (random() % max_y-4)+1;
-    asts[nAst].dx = -1;
-    asts[nAst].dy = 1;
-  } else {
-    asts[nAst].x = (random() % max_x-4)+1;
-    asts[nAst].y = max_y-4;
-    asts[nAst].dy = -1;
-    asts[nAst].dx = 1;
+  y0 = band * f->bandRows;
+  y1 = y0 + f->bandRows;
+  if (y1 > f->h) {
+    y1 = f->h;
+  }
+  if (y0 >= y1) {
+    return;
   }
+  memcpy(f->cells + y0*f->w, f->bg + y0*f->w, (y1-y0)*f->w*sizeof(chtype));
+  for (i = 0; i < f->nbin[band]; i++) {
+    blitCells(f, &f->blits[f->bins[band*f->cap + i]], y0, y1);
+  }
+}
 
-  asts[nAst].max_x = asts[nAst].x+9;
-  asts[nAst].max_y = asts[nAst].y+4;
-  //asts[nAst].dOb = dAst5[random() % 2][random() % 2];
-  asts[nAst].dOb = dAst5[random() % 3][0];
-  asts[nAst].color = YELLOW;
+void* renderWorker(void* arg) {
+  int band = (int)(long)arg;
 
-  asts[nAst].spWin = newpad(5, 10);
-  wattrset(asts[nAst].spWin,COLOR_PAIR(asts[nAst].color)); 
-  wclear(asts[nAst].spWin);
+  while (1) {
+    pthread_barrier_wait(&renderStart);
+    frameBand(renderJob, band);
+    pthread_barrier_wait(&renderDone);
+  }
+  return NULL;
 }
 
-void asteroidSplit(int nAst) {
-  
-  asts[lAst].speed = asts[nAst].speed;
-  asts[lAst].mvcnt = 0;
-  asts[lAst].subtype = 2;
-  asts[lAst].iter = lAst;
-  asts[lAst].draw = 1;
-  asts[lAst].x = asts[nAst].x+(random() % 6);
-  asts[lAst].y = asts[nAst].y+(random() % 6);
-  asts[lAst].max_x = asts[lAst].x+3;
-  asts[lAst].max_y = asts[lAst].y+2;
-  asts[lAst].color = YELLOW;
-  asts[lAst].dx = asts[nAst].dx;
-  asts[lAst].dy = asts[nAst].dy;
-  asts[lAst].dOb = dAst2[random() % 2][0];
-  
-  asts[lAst].spWin = newpad(3, 4);
-  wattrset(asts[lAst].spWin,COLOR_PAIR(asts[lAst].color));
-  wclear(asts[lAst].spWin);
-  spObRefresh(&asts[lAst]);
+void renderPoolStart() {
+  long i;
+
+  pthread_barrier_init(&renderStart, NULL, renderThreads);
+  pthread_barrier_init(&renderDone, NULL, renderThreads);
+  for (i = 1; i < renderThreads; i++) {
+    pthread_create(&renderWorkers[i], NULL, renderWorker, (void*)i);
+  }
+  renderPool = 1;
+}
 
-  spObOnBattleField(&asts[lAst]);
-  lAst++;
+void frameCompose(frameBuf* f, int bands) {
 
-  asteroidRemove(nAst);
+  if (bands > renderThreads) {
+    bands = renderThreads;
+  }
+  if (bands < 2) {
+    frameBin(f, 1);
+    frameBand(f, 0);
+    return;
+  }
+  if (!renderPool) {
+    renderPoolStart();
+  }
+  // every worker wakes, those past the last band find no rows; this thread takes band 0
+  frameBin(f, bands);
+  renderJob = f;
+  pthread_barrier_wait(&renderStart);
+  frameBand(f, 0);
+  pthread_barrier_wait(&renderDone);
 }
 
-void chestInit(int nChest) {
-  chests[nChest].dOb = "$";
-  chests[nChest].mvcnt = 0;
-  chests[nChest].iter = nChest;
-  chests[nChest].type = CHEST;
-  chests[nChest].color = BLUE;
-  chests[nChest].speed = 3;
-  chests[nChest].draw=1;
+void frameFlush(frameBuf* f, WINDOW* wElem) {
+  int y;
 
-  int tmp = 0;
-  tmp = (random() % 5);
-  
-  if (tmp == 4) {
-    chests[nChest].x = (random() % max_x-2)+1;
-    chests[nChest].y = 1;
-    chests[nChest].dx = -1;
-    chests[nChest].dy = 1;
-  } else if (tmp == 3) {
-    chests[nChest].x = 1;
-    chests[nChest].y = (random() % max_y-2)+1;
-    chests[nChest].dx = 1;
-    chests[nChest].dy = -1;
-  } else if (tmp == 2) {
-    chests[nChest].x = max_x-1;
-    chests[nChest].y = (random() % max_y-2)+1;
-    chests[nChest].dx = -1;
-    chests[nChest].dy = 1;
-  } else {
-    chests[nChest].x = (random() % max_x-2)+1;
-    chests[nChest].y = max_y - 1;
-    chests[nChest].dx = 1;
-    chests[nChest].dy = -1;
-  }
-
-  chests[nChest].max_x = chests[nChest].x;
-  chests[nChest].max_y = chests[nChest].y;
-
-  chests[nChest].spWin = newpad(1, 1);
-  wattrset(chests[nChest].spWin,chests[nChest].color);
-  wclear(chests[nChest].spWin);
-}
-
-static void ufoMissleInit(int nMiss) {
-
-  int dfx, dfy, dist, dist1, i;
-  int astNear = 0;
-
-  missles[nMiss].type = MISSLE;
-  missles[nMiss].dOb = "+";
-  missles[nMiss].iter = nMiss;
-  missles[nMiss].mvcnt = 0;
-  missles[nMiss].x = ufo.x+2;
-  missles[nMiss].y = ufo.y;
-  missles[nMiss].max_x = missles[nMiss].x;
-  missles[nMiss].max_y = missles[nMiss].y;
-  missles[nMiss].subtype = 1;
-  missles[nMiss].draw = 1;
-  missles[nMiss].speed = 1;
-
-  // UFO Aims for Asteroid
-  dfx = fabs(ufo.x - asts[0].x);
-  dfy = fabs(ufo.y - asts[0].y);
-  dist = sqrt((dfx*dfx)+(dfy*dfy));
-  for (i = 1; i < lAst; i++) {
-    asts[i].color = YELLOW;
-    //asts[astNear].color = WHITE;
-    dfx = fabs(ufo.x - asts[i].x);
-    dfy = fabs(ufo.y - asts[i].y);
-    dist1 = sqrt((dfx*dfx)+(dfy*dfy));
-    if (dist1 < dist) {
-      dist = dist1;
-      astNear = i;
-    }
-  }
-  asts[astNear].color = RED;
-  spObRefresh(&asts[astNear]);
-  spObOnBattleField(&asts[astNear]);
-
-  if ((ufo.x == asts[astNear].x) || (ufo.x >= asts[astNear].x && ufo.x <= asts[astNear].max_x)) {
-    missles[nMiss].dx = 0;
-    ufo.dS = 0;
-  } else if (ufo.x > asts[astNear].x) {
-    missles[nMiss].dx = -1;
-    ufo.dS = 1;
-  } else {
-    missles[nMiss].dx = 1;
-    ufo.dS = 2;
+  cursesEnter();
+  for (y = 0; y < f->h; y++) {
+    mvwaddchnstr(wElem, y, 0, f->cells + y*f->w, f->w);
   }
+  wnoutrefresh(wElem);
+  cursesLeave();
+  frameHandOff();
+}
 
-  if ((ufo.y == asts[astNear].y) || (ufo.y >= asts[astNear].y && ufo.y <= asts[astNear].max_y)) {
-    missles[nMiss].dy = 0;
-    
-  } else if (ufo.y > asts[astNear].y) {
-    missles[nMiss].dy = -1;
-  } else {
-    missles[nMiss].dy = 1;
+void frameCopywin(frameBuf* f, WINDOW* wElem, WINDOW* wBg) {
+  // the reference path: every blit goes through its pad and copywin
+  int i;
+  blit* b;
+
+  copywin(wBg, wElem, 0, 0, 0, 0, f->h-1, f->w-1, 0);
+  for (i = 0; i < f->nblits; i++) {
+    b = &f->blits[i];
+    // pads are shared between sprites, so fill it right before the copy
+    werase(b->pad);
+    wattrset(b->pad, b->attr);
+    waddnstr(b->pad, b->art, b->len);
+    copywin(b->pad, wElem, 0, 0, b->y, b->x, b->y+b->h-1, b->x+b->w-1, b->mode != BLIT_OPAQUE);
   }
-  
-  missles[nMiss].spWin = newpad(1, 1);
-  wattrset(missles[nMiss].spWin,missles[nMiss].color);
-  wclear(missles[nMiss].spWin);
 }
 
-static void missleInit(int nMiss) {
-  missles[nMiss].dOb = "+";
-  missles[nMiss].type = MISSLE;
-  missles[nMiss].iter = nMiss;
-  missles[nMiss].mvcnt = 0;
-  missles[nMiss].subtype = 0;
-  missles[nMiss].draw = 1;
-  missles[nMiss].speed = 1;
-  missles[nMiss].x = ship.x;
-  missles[nMiss].y = ship.y;
-  missles[nMiss].max_x = missles[nMiss].x;
-  missles[nMiss].max_y = missles[nMiss].y;
-  missles[nMiss].dx = dxShips[ship.dS];
-  missles[nMiss].dy = dyShips[ship.dS];
-  missles[nMiss].color = GREEN;
-  missles[nMiss].spWin = newpad(1, 1);
-  wattrset(missles[nMiss].spWin,missles[nMiss].color);
-  wclear(missles[nMiss].spWin);
+void frameFlushCurses(frameBuf* f, WINDOW* wElem, WINDOW* wBg) {
+  cursesEnter();
+  frameCopywin(f, wElem, wBg);
+  wnoutrefresh(wElem);
+  cursesLeave();
+  frameHandOff();
 }
 
-/* BATTLEFIELD */
+void drawOnBattleField(WINDOW *wElem, char* art, chtype attr, int x, int y, int xx, int yy) {
+  frameBlit(&gs->frame, x, y, xx-x+1, yy-y+1, getmaxx(wElem), art, attr, BLIT_OPAQUE, wElem);
+}
 
-static void starFieldInit() {
-  int i,j;
+/* timer wheel */
 
-  wEmpty = newpad(max_y, max_x);
-  wclear(wEmpty);
+void tmInit(tmWheel* w) {
+  int l, s;
 
-  wStarField = newpad(max_y, max_x);
-  wattrset(wStarField, COLOR_PAIR(YELLOW));
-  waddstr(wStarField, "*");
-  
-  for (i = 0; i<max_x; i++) {
-    j = random() % max_y;
-    copywin(wStarField, wEmpty,0,0,j,i,j,i,0);
+  memset(w, 0, sizeof(tmWheel));
+  for (l = 0; l < WHEEL_LEVELS; l++) {
+    for (s = 0; s < WHEEL_SLOTS; s++) {
+      w->slots[l][s].next = &w->slots[l][s];
+      w->slots[l][s].prev = &w->slots[l][s];
+    }
   }
-  box(wEmpty,0,0);
 }
 
-static void battleFieldInit() {
-  wBattleField = newwin(max_y, max_x, 0, 0);
-  wclear(wBattleField);
-  clearFromBattleField(0,0,max_x-1,max_y-1);
+void tmLink(tmWheel* w, tmEvent* ev) {
+  // an event sits on the lowest level whose higher bits it shares with now
+  int l = 0;
+  tmEvent* head;
+
+  while (l < WHEEL_LEVELS-1 && (ev->due >> (WHEEL_BITS*(l+1))) != (w->now >> (WHEEL_BITS*(l+1)))) {
+    l++;
+  }
+  head = &w->slots[l][(ev->due >> (WHEEL_BITS*l)) & (WHEEL_SLOTS-1)];
+  ev->next = head->next;
+  ev->prev = head;
+  head->next->prev = ev;
+  head->next = ev;
+  ev->level = l;
+  w->pending[l]++;
 }
 
-void battleFieldClear() {
-  wclear(wBattleField);
-  clearFromBattleField(0,0,max_x-1,max_y-1);
+void tmUnlink(tmWheel* w, tmEvent* ev) {
+  ev->prev->next = ev->next;
+  ev->next->prev = ev->prev;
+  ev->next = ev->prev = NULL;
+  w->pending[ev->level]--;
 }
 
-/* title screen */
+int tmPending(tmEvent* ev) {
+  return ev->next != NULL;
+}
 
-static void titleScreenInit() {  
-  wTitleScreen = newpad(max_y, max_x);
-  wclear(wTitleScreen);
+void tmSchedule(tmWheel* w, tmEvent* ev, int kind, int arg, unsigned long ticks) {
+  if (tmPending(ev)) {
+    tmUnlink(w, ev);
+  }
+  if (ticks < 1) {
+    ticks = 1; // the current slot is being drained
+  } else if (ticks >= WHEEL_SPAN) {
+    ticks = WHEEL_SPAN-1;
+  }
+  ev->kind = kind;
+  ev->arg = arg;
+  ev->due = w->now + ticks;
+  tmLink(w, ev);
+  w->scheduled++;
 }
 
-void titleScreenDisplay() {
+void tmCancel(tmWheel* w, tmEvent* ev) {
+  if (tmPending(ev)) {
+    tmUnlink(w, ev);
+    w->cancelled++;
+  }
+}
 
-  int x, y;
-  WINDOW *wTitleText;
-  WINDOW *wStartText;
+void tmAdvance(tmWheel* w, void (*fire)(tmEvent*)) {
+  int l;
+  tmEvent *head, *ev;
+
+  w->now++;
+  // refill the levels below from the top down as their slots come round
+  for (l = WHEEL_LEVELS-1; l > 0; l--) {
+    if ((w->now & ((1UL << (WHEEL_BITS*l)) - 1)) == 0) {
+      head = &w->slots[l][(w->now >> (WHEEL_BITS*l)) & (WHEEL_SLOTS-1)];
+      while (head->next != head) {
+	ev = head->next;
+	tmUnlink(w, ev);
+	tmLink(w, ev);
+	w->cascaded++;
+      }
+    }
+  }
+  head = &w->slots[0][w->now & (WHEEL_SLOTS-1)];
+  while (head->next != head) {
+    ev = head->next;
+    tmUnlink(w, ev);
+    w->fired++;
+    fire(ev);
+  }
+}
 
-  /* big title */
-  wTitleText = newpad(3, 45);
-  wclear(wTitleText);
-  wattrset(wTitleText, COLOR_PAIR(YELLOW));
-  waddstr(wTitleText, "  //_\\/ __|_   _| __| _ \\\\ \\ / / _ \\_ _|   \\ ");
-  waddstr(wTitleText, " // _ \\__ \\ | | | _||   / \\ V / (_) | || |) |");
-  waddstr(wTitleText, "//_/ \\____/ |_| |___|_|_\\  \\_/ \\___/___|___/ "); 
-
-  x = (max_x / 2) - (45 / 2);
-  y = 0;
-  displayOnBattleField(wTitleText,x,y,x+44,y+2);  
+unsigned long geometricTicks(double p) {
+  // ticks until the first success of a per tick chance p
+  double u = (random() + 1.0) / (RAND_MAX + 2.0);
+  return 1 + (unsigned long)(log(u) / log(1.0 - p));
+}
 
-  /* info text */
-  wStartText = newpad(1, 20);
-  wclear(wStartText);
-  wattrset(wStartText, COLOR_PAIR(RED));
-  waddstr(wStartText, "Press SPACE to start");
+/* effects */
+
+int effectStart(int kind, int x, int y, int width, int height, char* art, char* alt, int ticks) {
+  int i;
+  fxOb* fx;
 
-  x = (max_x / 2) - (20 / 2);
-  y = max_y - 2;
-  displayOnBattleField(wStartText,x,y,x+19,y);
+  for (i = 0; i < MAX_EFFECTS; i++) {
+    if (gs->effects[i].kind < 0) {
+      break;
+    }
+  }
+  if (i == MAX_EFFECTS || width*height >= (int)sizeof(gs->effects[i].buf)) {
+    return -1; // too much going on, skip the animation
+  }
+  fx = &gs->effects[i];
+  fx->kind = kind;
+  fx->x = x;
+  fx->y = y;
+  fx->w = width;
+  fx->h = height;
+  fx->art = art;
+  fx->alt = alt;
+  fx->start = gs->renderFrames;
+  fx->seed = random();
+  fx->pad = shapePad(height, width);
+  tmSchedule(&gs->wheel, &fx->ev, EV_EFFECT, i, ticks);
+  return i;
 }
 
-void titleScreenClear() {
-  battleFieldClear();
-  battleFieldInit();
+void effectStop(int i) {
+  tmCancel(&gs->wheel, &gs->effects[i].ev);
+  gs->effects[i].kind = -1;
 }
 
-/* gameover  */
+void effectsClear() {
+  int i;
 
-static void gameOverInit() {
-  wGameOver = newpad(13, 31);
-  wclear(wGameOver);
-  wattrset(wGameOver, COLOR_PAIR(GREEN));
-  waddstr(wGameOver, "                               ");
-  waddstr(wGameOver, "  #####   ####  ##   ## ###### ");
-  waddstr(wGameOver, " ##      ##  ## ####### ##     ");
-  waddstr(wGameOver, " ## ###  ###### ## # ## #####  ");
-  waddstr(wGameOver, " ##  ##  ##  ## ##   ## ##     ");
-  waddstr(wGameOver, "  #####  ##  ## ##   ## ###### ");
-  waddstr(wGameOver, "                               ");
-  waddstr(wGameOver, "  ####  ##   ## ###### ######  ");
-  waddstr(wGameOver, " ##  ## ##   ## ##     ##   ## ");
-  waddstr(wGameOver, " ##  ##  ## ##  #####  ######  ");
-  waddstr(wGameOver, " ##  ##  ## ##  ##     ##  ##  ");
-  waddstr(wGameOver, "  ####    ###   ###### ##   ## ");
-  waddstr(wGameOver, "                               ");
+  if (gs->effects == NULL) {
+    return; // no game yet
+  }
+  for (i = 0; i < MAX_EFFECTS; i++) {
+    if (gs->effects[i].kind >= 0) {
+      effectStop(i);
+    }
+  }
 }
 
-void gameOverDisplay() {
-  WINDOW *wStartText;
+void effectDraw(fxOb* fx) {
+  char explosionChars[18+1]="@~`.,^#*-_=\\/%{}  ";
+  long t = gs->renderFrames - fx->start;
+  char* art = fx->art;
+  int i;
 
-  int x = (max_x / 2) - (31 / 2);
-  int y = (max_y / 2) - (13 / 2);
-  displayOnBattleField(wGameOver,x,y,x+30,y+12);
+  if (fx->kind == FX_BREAK && t % 2 == 1) {
+    art = fx->alt;
+  } else if (fx->kind == FX_EXPLOSION) {
+    // own rand_r state, so drawing never moves the game's random()
+    for (i = 0; i < fx->w*fx->h; i++) {
+      fx->buf[i] = explosionChars[rand_r(&fx->seed)%18];
+    }
+    fx->buf[i] = '\0';
+    art = fx->buf;
+  }
+  frameBlit(&gs->frame, fx->x, fx->y, fx->w, fx->h, fx->w, art, COLOR_PAIR(mod(t,6)), art == fx->buf ? BLIT_CLEAR : BLIT_SPRITE, fx->pad);
+}
 
-  /* info text */
-  wStartText = newpad(1, 22);
-  wclear(wStartText);
-  wattrset(wStartText, COLOR_PAIR(RED));
-  waddstr(wStartText, "Press SPACE to restart");
-  x = (max_x / 2) - (22 / 2);
-  y = max_y - 2;
+void bonusDisplay(int x, int y, int width, int height, char* db){
+  effectStart(FX_BONUS, x, y, width, height, db, db, FX_BONUS_TICKS);
+}
 
-  displayOnBattleField(wStartText,x,y,x+21,y);
+void breakDisplay(int nAst){
+  effectStart(FX_BREAK, gs->asts[nAst].x, gs->asts[nAst].y, getmaxx(gs->asts[nAst].spWin), getmaxy(gs->asts[nAst].spWin), gs->asts[nAst].dOb, dAst2[0][0], FX_BREAK_TICKS);
 }
 
-void gameOverClear()  {
-  int x = (max_x / 2) - (31 / 2);
-  int y = (max_y / 2) - (13 / 2);
-  clearFromBattleField(x,y,x+30,y+12);
+void explosionDisplay(int x, int y, int width, int height) {
+  effectStart(FX_EXPLOSION, x, y, width, height, NULL, NULL, FX_EXPLOSION_TICKS);
 }
 
-/* paused */
+/* collisions */
 
-static void gamePausedInit() {
-  wGamePaused = newpad(10, 41);
-  wclear(wGamePaused);
-  wattrset(wGamePaused, COLOR_PAIR(GREEN));
-  waddstr(wGamePaused, "###### ###### ##  ##  ##### ###### ##### ");
-  waddstr(wGamePaused, "###### ###### ##  ## ###### ###### ######");
-  waddstr(wGamePaused, "##  ## ##  ## ##  ## ##     ##     ##  ##");
-  waddstr(wGamePaused, "##  ## ##  ## ##  ## ##     ##     ##  ##");
-  waddstr(wGamePaused, "###### ###### ##  ## ###### ###### ##  ##");
-  waddstr(wGamePaused, "###### ###### ##  ## ###### ###### ##  ##");
-  waddstr(wGamePaused, "##     ##  ## ##  ##     ## ##     ##  ##");
-  waddstr(wGamePaused, "##     ##  ## ##  ##     ## ##     ##  ##");
-  waddstr(wGamePaused, "##     ##  ## ###### ###### ###### ######");
-  waddstr(wGamePaused, "##     ##  ## ###### #####  ###### ##### ");
+int collisionP(int sx, int sy, int sxx, int syy, int tx, int ty, int txx, int tyy) {
+
+  if ((sy >= ty && sy <= tyy) || syy >= ty && syy <= tyy) {
+    if ((sx >= tx && sx <= txx) || sxx >= tx && sxx <= txx) {
+      return 1;
+    }
+  }
+  return 0;
 }
 
-void gamePausedDisplay() {
-  int x = (max_x / 2) - (41 / 2);
-  int y = (max_y / 2) - (10 / 2);
-  displayOnBattleField(wGamePaused,x,y,x+40,y+9);
+int spObCollision(spOb* st0, spOb* st1) {
+  return collisionP(st0->x,st0->y,st0->max_x,st0->max_y,st1->x,st1->y,st1->max_x,st1->max_y);
 }
 
-void gamePausedClear()  {
-  int x = (max_x / 2) - (41 / 2);
-  int y = (max_y / 2) - (10 / 2);
-  clearFromBattleField(x,y,x+40,y+9);
+int spObTouch(spOb* st0, spOb* st1) {
+  // collisionP only looks for st0's edges in st1, so a small box inside a big one needs both ways
+  return spObCollision(st0, st1) || spObCollision(st1, st0);
 }
 
-/* Status Bar  */
+/* swept collisions */
 
-void statusInit() {
-  wStatus = newpad(1, 70);
-  wclear(wStatus);
+int wrapDelta(int d, int m) {
+  // shortest signed distance on a wrapping axis of length m
+  d = mod(d, m);
+  if (d > m/2) {
+    d-=m;
+  }
+  return d;
 }
 
-void statusDisplay() {
-  char strStatus[70];
+int segmentBox(double sx, double sy, double ex, double ey, double tx, double ty, double txx, double tyy) {
+  // slab test of segment (sx,sy)->(ex,ey) against box [tx,txx]x[ty,tyy]
+  double t0 = 0.0, t1 = 1.0, a, b, tmp;
+  double d[2] = {ex-sx, ey-sy};
+  double s[2] = {sx, sy};
+  double lo[2] = {tx, ty};
+  double hi[2] = {txx, tyy};
+  int k;
+
+  for (k = 0; k < 2; k++) {
+    if (d[k] == 0.0) {
+      if (s[k] < lo[k] || s[k] > hi[k]) {
+	return 0;
+      }
+    } else {
+      a = (lo[k] - s[k]) / d[k];
+      b = (hi[k] - s[k]) / d[k];
+      if (a > b) {
+	tmp = a; a = b; b = tmp;
+      }
+      if (a > t0) t0 = a;
+      if (b < t1) t1 = b;
+      if (t0 > t1) {
+	return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+int spObSweep(spOb* mv, spOb* st) {
+  // sweep the single-cell mover along its last step against st, both
+  // taken relative to st's own last step, on the wrapping battlefield
+  int mdx, mdy, sdx, sdy, w, h, sx, sy, ex, ey, ox, oy;
+  int bx, by, bxx, byy;
+
+  mdx = wrapDelta(mv->x - mv->px, gs->max_x);
+  mdy = wrapDelta(mv->y - mv->py, gs->max_y);
+  sdx = wrapDelta(st->x - st->px, gs->max_x);
+  sdy = wrapDelta(st->y - st->py, gs->max_y);
+  w = mod(st->max_x - st->x, gs->max_x);
+  h = mod(st->max_y - st->y, gs->max_y);
+
+  ex = mv->x;
+  ey = mv->y;
+  sx = ex - (mdx - sdx);
+  sy = ey - (mdy - sdy);
+
+  for (ox = -gs->max_x; ox <= gs->max_x; ox+=gs->max_x) {
+    for (oy = -gs->max_y; oy <= gs->max_y; oy+=gs->max_y) {
+      bx = st->x + ox;
+      by = st->y + oy;
+      bxx = bx + w;
+      byy = by + h;
+      // broadphase: bounding box of the sweep against st
+      if ((sx < ex ? ex : sx) < bx || (sx < ex ? sx : ex) > bxx ||
+	  (sy < ey ? ey : sy) < by || (sy < ey ? sy : ey) > byy) {
+	continue;
+      }
+      // cells are unit squares, so sweep the cell centre against the grown box
+      if (segmentBox(sx+0.5, sy+0.5, ex+0.5, ey+0.5, bx, by, bxx+1, byy+1)) {
+	return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/* id raster */
+
+int rasterExtent(int lo, int hi, int m) {
+  // cells past lo an ob's box reaches: enough for the plain box test on
+  // raw coordinates and for the swept one's wrapped width, the whole axis at most
+  int ext = mod(hi - lo, m);
+
+  if (hi - lo > ext) {
+    ext = hi - lo;
+  }
+  return ext < m ? ext : m-1;
+}
+
+void rasterReset() {
+  // a new field or a new game: nothing painted, every slot free
+  int i, n = gs->max_x*gs->max_y;
+
+  free(gs->rasterId);
+  free(gs->rasterMore);
+  gs->rasterId = calloc(n, sizeof(short));
+  gs->rasterMore = malloc(n*sizeof(int));
+  memset(gs->rasterMore, 0xff, n*sizeof(int));
+  gs->rasterW = gs->max_x;
+  gs->rasterH = gs->max_y;
+  gs->nRasterNodes = 0;
+  gs->rasterFreeNode = -1;
+  for (i = 0; i < MAX_ASTEROIDS; i++) {
+    gs->slotLive[i] = 0;
+    gs->slotFree[i] = MAX_ASTEROIDS-1-i;
+  }
+  gs->nSlotFree = MAX_ASTEROIDS;
+  for (i = 0; i < gs->lAst; i++) {
+    gs->asts[i].slot = -1;
+  }
+  gs->nPairs = 0;
+}
+
+void rasterDraw(int slot, spOb* a) {
+  // slot onto every cell of a's box
+  int x, y, c, k;
+  int ex = rasterExtent(a->x, a->max_x, gs->max_x), ey = rasterExtent(a->y, a->max_y, gs->max_y);
+
+  for (y = 0; y <= ey; y++) {
+    for (x = 0; x <= ex; x++) {
+      c = mod(a->y + y, gs->max_y)*gs->max_x + mod(a->x + x, gs->max_x);
+      if (gs->rasterId[c] == 0) {
+	gs->rasterId[c] = slot+1;
+	continue;
+      }
+      // overlaps go on a chain, rare enough to grow as needed
+      if ((k = gs->rasterFreeNode) >= 0) {
+	gs->rasterFreeNode = gs->rasterNodes[k].next;
+      } else {
+	if (gs->nRasterNodes == gs->capRasterNodes) {
+	  gs->capRasterNodes = gs->capRasterNodes ? 2*gs->capRasterNodes : 256;
+	  gs->rasterNodes = realloc(gs->rasterNodes, gs->capRasterNodes*sizeof(rasterNode));
+	}
+	k = gs->nRasterNodes++;
+      }
+      gs->rasterNodes[k].id = slot;
+      gs->rasterNodes[k].next = gs->rasterMore[c];
+      gs->rasterMore[c] = k;
+    }
+  }
+  gs->slotBox[slot].x = a->x;
+  gs->slotBox[slot].y = a->y;
+  gs->slotBox[slot].xx = a->max_x;
+  gs->slotBox[slot].yy = a->max_y;
+  gs->perf.rasterCells += (ex+1)*(ey+1);
+}
+
+void rasterErase(int slot) {
+  // slot off the cells it was painted on
+  rasterBox* b = &gs->slotBox[slot];
+  int x, y, c, k, *link;
+  int ex = rasterExtent(b->x, b->xx, gs->max_x), ey = rasterExtent(b->y, b->yy, gs->max_y);
+
+  for (y = 0; y <= ey; y++) {
+    for (x = 0; x <= ex; x++) {
+      c = mod(b->y + y, gs->max_y)*gs->max_x + mod(b->x + x, gs->max_x);
+      if (gs->rasterId[c] == slot+1) {
+	// the chain's first moves up
+	if ((k = gs->rasterMore[c]) >= 0) {
+	  gs->rasterId[c] = gs->rasterNodes[k].id+1;
+	  gs->rasterMore[c] = gs->rasterNodes[k].next;
+	  gs->rasterNodes[k].next = gs->rasterFreeNode;
+	  gs->rasterFreeNode = k;
+	} else {
+	  gs->rasterId[c] = 0;
+	}
+	continue;
+      }
+      for (link = &gs->rasterMore[c]; *link >= 0; link = &gs->rasterNodes[*link].next) {
+	if (gs->rasterNodes[*link].id == slot) {
+	  k = *link;
+	  *link = gs->rasterNodes[k].next;
+	  gs->rasterNodes[k].next = gs->rasterFreeNode;
+	  gs->rasterFreeNode = k;
+	  break;
+	}
+      }
+    }
+  }
+}
+
+void rasterUpdate() {
+  // bring the raster up to this tick's positions: only the asteroids that
+  // changed cells, came or went are taken off and painted again
+  rasterBox* b;
+  int i, d, s;
+  spOb* a;
+
+  if (gs->rasterW != gs->max_x || gs->rasterH != gs->max_y) {
+    rasterReset();
+  }
+  memset(gs->slotAst, 0xff, MAX_ASTEROIDS*sizeof(short));
+  gs->rasterSx = gs->rasterSy = 0;
+
+  // the slots still held, then whatever went since the last tick, so a
+  // new asteroid at the cap finds the one it replaced free
+  for (i = 0; i < gs->lAst; i++) {
+    a = &gs->asts[i];
+    if (!a->draw || a->slot < 0 || !gs->slotLive[a->slot] || gs->slotAst[a->slot] >= 0) {
+      a->slot = -1;
+      continue;
+    }
+    gs->slotAst[a->slot] = i;
+  }
+  for (s = 0; s < MAX_ASTEROIDS; s++) {
+    if (gs->slotLive[s] && gs->slotAst[s] < 0) {
+      rasterErase(s);
+      gs->slotLive[s] = 0;
+      gs->slotFree[gs->nSlotFree++] = s;
+    }
+  }
+
+  for (i = 0; i < gs->lAst; i++) {
+    a = &gs->asts[i];
+    gs->astMoved[i] = 0;
+    if (!a->draw) {
+      continue;
+    }
+    d = abs(wrapDelta(a->x - a->px, gs->max_x));
+    gs->rasterSx = d > gs->rasterSx ? d : gs->rasterSx;
+    d = abs(wrapDelta(a->y - a->py, gs->max_y));
+    gs->rasterSy = d > gs->rasterSy ? d : gs->rasterSy;
+    gs->perf.astSeen++;
+    if (a->slot >= 0) {
+      b = &gs->slotBox[a->slot];
+      if (b->x == a->x && b->y == a->y && b->xx == a->max_x && b->yy == a->max_y) {
+	continue; // still where it was painted
+      }
+      rasterErase(a->slot);
+    } else {
+      a->slot = gs->slotFree[--gs->nSlotFree];
+      gs->slotAst[a->slot] = i;
+      gs->slotLive[a->slot] = 1;
+    }
+    rasterDraw(a->slot, a);
+    gs->astMoved[i] = 1;
+    gs->perf.astMoved++;
+  }
+}
+
+void rasterBegin() {
+  gs->nRasterCand = 0;
+  if (++gs->rasterStamp == 0) {
+    memset(gs->astStamp, 0, MAX_ASTEROIDS*sizeof(unsigned int));
+    gs->rasterStamp = 1;
+  }
+}
+
+void rasterFound(int id) {
+  if (gs->astStamp[id] != gs->rasterStamp) {
+    gs->astStamp[id] = gs->rasterStamp;
+    gs->rasterCand[gs->nRasterCand++] = id;
+  }
+}
+
+void rasterCells(int x0, int y0, int x1, int y1) {
+  // every asteroid on the cells x0..x1 by y0..y1, wrapping
+  int x, y, c, k;
+
+  if (x1 - x0 >= gs->max_x) {
+    x0 = 0;
+    x1 = gs->max_x-1;
+  }
+  if (y1 - y0 >= gs->max_y) {
+    y0 = 0;
+    y1 = gs->max_y-1;
+  }
+  for (y = y0; y <= y1; y++) {
+    for (x = x0; x <= x1; x++) {
+      c = mod(y, gs->max_y)*gs->max_x + mod(x, gs->max_x);
+      if (gs->rasterId[c]) {
+	rasterFound(gs->slotAst[gs->rasterId[c]-1]);
+      }
+      for (k = gs->rasterMore[c]; k >= 0; k = gs->rasterNodes[k].next) {
+	rasterFound(gs->slotAst[gs->rasterNodes[k].id]);
+      }
+    }
+  }
+}
+
+int rasterEnd() {
+  // ascending, so the hits come out in the order a scan finds them
+  int i, j;
+  short id;
+
+  for (i = 1; i < gs->nRasterCand; i++) {
+    id = gs->rasterCand[i];
+    for (j = i; j > 0 && gs->rasterCand[j-1] > id; j--) {
+      gs->rasterCand[j] = gs->rasterCand[j-1];
+    }
+    gs->rasterCand[j] = id;
+  }
+  gs->perf.rasterTests += gs->nRasterCand;
+  return gs->nRasterCand;
+}
+
+int rasterCorners(spOb* s) {
+  // spObCollision(s, other) only ever finds one of s's corners inside the
+  // other box; asteroid pairs go both ways round, so they use rasterArea
+  rasterBegin();
+  rasterCells(s->x, s->y, s->x, s->y);
+  rasterCells(s->max_x, s->y, s->max_x, s->y);
+  rasterCells(s->x, s->max_y, s->x, s->max_y);
+  rasterCells(s->max_x, s->max_y, s->max_x, s->max_y);
+  return rasterEnd();
+}
+
+int rasterArea(spOb* s) {
+  // every asteroid sharing a cell with s: any box touching s either way round
+  rasterBegin();
+  rasterCells(s->x, s->y, s->x + rasterExtent(s->x, s->max_x, gs->max_x), s->y + rasterExtent(s->y, s->max_y, gs->max_y));
+  return rasterEnd();
+}
+
+int rasterSweep(spOb* mv) {
+  // the cells mv crossed this tick, grown by as far as any asteroid moved:
+  // a swept hit lands there whichever asteroid it is
+  int dx = wrapDelta(mv->x - mv->px, gs->max_x);
+  int dy = wrapDelta(mv->y - mv->py, gs->max_y);
+  int x0 = dx < 0 ? mv->x : mv->x - dx, x1 = dx < 0 ? mv->x - dx : mv->x;
+  int y0 = dy < 0 ? mv->y : mv->y - dy, y1 = dy < 0 ? mv->y - dy : mv->y;
+
+  rasterBegin();
+  rasterCells(x0 - gs->rasterSx, y0 - gs->rasterSy, x1 + gs->rasterSx, y1 + gs->rasterSy);
+  return rasterEnd();
+}
+
+void shipScore(int n) {
+  gs->ship.score+=n;
+  if (gs->ship.score > gs->stats.level*100 && !tmPending(&gs->levelEvent)) {
+    tmSchedule(&gs->wheel, &gs->levelEvent, EV_LEVEL, 0, 1);
+  }
+}
+
+void ufoKill(int k) {
+  gs->ufos[k].draw = 0;
+  if (!tmPending(&gs->ufoEvents[k])) {
+    tmSchedule(&gs->wheel, &gs->ufoEvents[k], EV_UFO, k, UFO_RESPAWN);
+  }
+}
+
+void hitEmit(int kind, int a, int b) {
+  hitEvent* e;
+
+  if (gs->nHits == MAX_HITS) {
+    gs->perf.hitsDropped++; // still touching next tick, if it matters
+    return;
+  }
+  e = &gs->hits[gs->nHits++];
+  e->kind = kind;
+  e->a = a;
+  e->b = b;
+  e->tick = gs->wheel.now;
+}
+
+void astPairAdd(int* n, int i, int j) {
+  if (*n < MAX_HITS) {
+    gs->pairsNow[*n].a = i;
+    gs->pairsNow[*n].b = j;
+  }
+  (*n)++;
+}
+
+int astPairs() {
+  // asteroids touching this tick, in the order a scan finds them: the pairs
+  // from last tick where neither has moved since still touch, so only the
+  // asteroids that moved are looked around
+  int i, j, c, n, np = 0, all = gs->nPairs < 0;
+  astPair t;
+
+  for (c = 0; c < gs->nPairs; c++) {
+    i = gs->slotAst[gs->pairs[c].a];
+    j = gs->slotAst[gs->pairs[c].b];
+    if (i >= 0 && j >= 0 && !gs->astMoved[i] && !gs->astMoved[j]) {
+      astPairAdd(&np, i, j);
+      gs->perf.pairsKept++;
+    }
+  }
+  for (i = 0; i < gs->lAst; i++) {
+    gs->perf.scanTests += gs->lAst-i-1;
+    if (!gs->asts[i].draw || !(gs->astMoved[i] || all)) {
+      continue;
+    }
+    // everything on i's cells: corners in either box, or one inside the
+    // other; an earlier one only if it stood still, a moved one finds i itself
+    n = rasterArea(&gs->asts[i]);
+    for (c = 0; c < n; c++) {
+      j = gs->rasterCand[c];
+      if (j > i && spObTouch(&gs->asts[i], &gs->asts[j])) {
+	astPairAdd(&np, i, j);
+      } else if (j < i && !all && !gs->astMoved[j] && spObTouch(&gs->asts[j], &gs->asts[i])) {
+	astPairAdd(&np, j, i);
+      }
+    }
+  }
+  if (np > MAX_HITS) {
+    gs->nPairs = -1; // too many to keep: next tick looks at every asteroid again
+    np = MAX_HITS;
+  } else {
+    gs->nPairs = np;
+  }
+  for (c = 1; c < np; c++) {
+    t = gs->pairsNow[c];
+    for (j = c; j > 0 && (gs->pairsNow[j-1].a > t.a || (gs->pairsNow[j-1].a == t.a && gs->pairsNow[j-1].b > t.b)); j--) {
+      gs->pairsNow[j] = gs->pairsNow[j-1];
+    }
+    gs->pairsNow[j] = t;
+  }
+  for (c = 0; c < gs->nPairs; c++) {
+    gs->pairs[c].a = gs->asts[gs->pairsNow[c].a].slot;
+    gs->pairs[c].b = gs->asts[gs->pairsNow[c].b].slot;
+  }
+  return np;
+}
+
+void collisionDetect() {
+  // only looks: everything the hits do is left to collisionResolve()
+  int i, j, k, c, n;
+
+  gs->nHits = 0;
+  rasterUpdate();
+
+  // ship and ufo collide
+  for (k = 0; k < gs->nUfo; k++) {
+    if (gs->ufos[k].draw && spObCollision(&gs->ship, &gs->ufos[k])) {
+      hitEmit(HIT_SHIP_UFO, k, 0);
+    }
+  }
+
+  // ship and chest collide
+  for (i = 0; i < gs->lChest; i++) {
+    if (!gs->chests[i].draw) {
+      continue;
+    }
+    if (spObCollision(&gs->ship, &gs->chests[i])) {
+      hitEmit(HIT_SHIP_CHEST, 0, i);
+      continue;
+    }
+    for (k = 0; k < gs->nUfo; k++) {
+      if (gs->ufos[k].draw && spObCollision(&gs->ufos[k], &gs->chests[i])) {
+	hitEmit(HIT_UFO_CHEST, k, i);
+	break;
+      }
+    }
+  }
+
+  // missle hits something
+  for (i = 0; i < gs->lMiss; i++) {
+    if (!gs->missles[i].draw) {
+      continue;
+    }
+    if (gs->missles[i].subtype == 1) {
+      if (spObSweep(&gs->missles[i],&gs->ship)) {
+	hitEmit(HIT_SHIP_MISSLE, i, 0);
+      }
+    } else if (gs->missles[i].subtype == 0) {
+      for (k = 0; k < gs->nUfo; k++) {
+	if (gs->ufos[k].draw && spObSweep(&gs->missles[i],&gs->ufos[k])) {
+	  hitEmit(HIT_UFO_MISSLE, i, k);
+	}
+      }
+    }
+    n = rasterSweep(&gs->missles[i]);
+    gs->perf.scanTests += gs->lAst;
+    for (c = 0; c < n; c++) {
+      j = gs->rasterCand[c];
+      if (spObSweep(&gs->missles[i],&gs->asts[j])) {
+	hitEmit(HIT_AST_MISSLE, i, j);
+      }
+    }
+  }
+
+  // the ship and ufos against asteroids, kept until the asteroid's turn below
+  memset(gs->astTouch, 0, gs->lAst*sizeof(unsigned long long));
+  n = rasterCorners(&gs->ship);
+  for (c = 0; c < n; c++) {
+    if (spObCollision(&gs->ship, &gs->asts[gs->rasterCand[c]])) {
+      gs->astTouch[gs->rasterCand[c]] |= TOUCH_SHIP;
+    }
+  }
+  gs->perf.scanTests += gs->lAst;
+  for (k = 0; k < gs->nUfo; k++) {
+    if (!gs->ufos[k].draw) {
+      continue;
+    }
+    n = rasterCorners(&gs->ufos[k]);
+    for (c = 0; c < n; c++) {
+      if (spObCollision(&gs->ufos[k], &gs->asts[gs->rasterCand[c]])) {
+	gs->astTouch[gs->rasterCand[c]] |= 1ULL << k;
+      }
+    }
+    gs->perf.scanTests += gs->lAst;
+  }
+
+  // asteroid hits something
+  n = astPairs();
+  c = 0;
+  for (i = 0; i < gs->lAst; i++) {
+    if (!gs->asts[i].draw) {
+      continue;
+    }
+    if (gs->astTouch[i] & TOUCH_SHIP) {
+      hitEmit(HIT_SHIP_AST, 0, i);
+    }
+    for (k = 0; k < gs->nUfo; k++) {
+      if (gs->astTouch[i] & (1ULL << k)) {
+	hitEmit(HIT_UFO_AST, k, i);
+      }
+    }
+    for (; c < n && gs->pairsNow[c].a == i; c++) {
+      hitEmit(HIT_AST_AST, i, gs->pairsNow[c].b);
+    }
+  }
+}
+
+/* gravity */
+
+double wrapNear(double d, double m) {
+  // the shortest way round a wrapping axis of length m
+  d = fmod(d, m);
+  if (d > m/2) {
+    d -= m;
+  } else if (d < -m/2) {
+    d += m;
+  }
+  return d;
+}
+
+int bhNodeNew(bhTree* t, double x0, double y0, double size) {
+  bhNode* nd;
+
+  if (t->n == t->cap) {
+    t->cap = t->cap ? 2*t->cap : 1024;
+    t->nodes = realloc(t->nodes, t->cap*sizeof(bhNode));
+  }
+  nd = &t->nodes[t->n];
+  nd->x0 = x0;
+  nd->y0 = y0;
+  nd->size = size;
+  nd->cx = nd->cy = nd->m = 0.0;
+  nd->lx = nd->ly = HUGE_VAL;
+  nd->hx = nd->hy = -HUGE_VAL;
+  nd->child = -1;
+  nd->body = -1;
+  return t->n++;
+}
+
+int bhQuad(bhNode* nd, double x, double y) {
+  return (x >= nd->x0 + nd->size/2) + 2*(y >= nd->y0 + nd->size/2);
+}
+
+void bhSplit(bhTree* t, int k) {
+  double x0 = t->nodes[k].x0, y0 = t->nodes[k].y0, half = t->nodes[k].size/2;
+  int c;
+
+  // the four are made together, so they sit side by side
+  c = bhNodeNew(t, x0, y0, half);
+  bhNodeNew(t, x0+half, y0, half);
+  bhNodeNew(t, x0, y0+half, half);
+  bhNodeNew(t, x0+half, y0+half, half);
+  t->nodes[k].child = c;
+}
+
+void bhInsert(bhTree* t, bhBody* bodies, int b) {
+  // down to an empty leaf, splitting an occupied one on the way
+  double x = bodies[b].x, y = bodies[b].y;
+  int k = 0, depth, old;
+
+  for (depth = 0; ; depth++) {
+    bhNode* nd = &t->nodes[k];
+
+    nd->cx += x*bodies[b].m;
+    nd->cy += y*bodies[b].m;
+    nd->m += bodies[b].m;
+    nd->lx = x < nd->lx ? x : nd->lx;
+    nd->ly = y < nd->ly ? y : nd->ly;
+    nd->hx = x > nd->hx ? x : nd->hx;
+    nd->hy = y > nd->hy ? y : nd->hy;
+    if (nd->child < 0) {
+      if (nd->m == bodies[b].m) {
+	nd->body = b; // was empty
+	return;
+      }
+      if (depth == BH_DEPTH) {
+	nd->body = -1; // all but on top of each other, they share it
+	return;
+      }
+      old = nd->body;
+      bhSplit(t, k); // may move the nodes
+      nd = &t->nodes[k];
+      nd->body = -1;
+      if (old >= 0) {
+	bhNode* ch = &t->nodes[nd->child + bhQuad(nd, bodies[old].x, bodies[old].y)];
+	ch->cx = bodies[old].x*bodies[old].m;
+	ch->cy = bodies[old].y*bodies[old].m;
+	ch->m = bodies[old].m;
+	ch->lx = ch->hx = bodies[old].x;
+	ch->ly = ch->hy = bodies[old].y;
+	ch->body = old;
+      }
+    }
+    k = nd->child + bhQuad(nd, x, y);
+  }
+}
+
+void bhBuild(bhTree* t, bhBody* bodies, int n, double w, double h) {
+  int i;
+
+  t->n = 0;
+  t->w = w;
+  t->h = h;
+  t->range = GRAVITY_RANGE * (w < h ? w : h)/2;
+  bhNodeNew(t, 0.0, 0.0, w > h ? w : h);
+  for (i = 0; i < n; i++) {
+    bhInsert(t, bodies, i);
+  }
+  // sums so far, centres from here on
+  for (i = 0; i < t->n; i++) {
+    if (t->nodes[i].m > 0.0) {
+      t->nodes[i].cx /= t->nodes[i].m;
+      t->nodes[i].cy /= t->nodes[i].m;
+    }
+  }
+}
+
+void bhPull(double dx, double dy, double m, double range, double* ax, double* ay) {
+  // softened inverse square, along (dx,dy), tapering to nothing at range
+  // so a node straddling the edge is not all or nothing
+  double q = (dx*dx + dy*dy) / (range*range);
+  double r2 = dx*dx + dy*dy + GRAVITY_SOFT*GRAVITY_SOFT;
+  double f = GRAVITY_G * m / (r2 * sqrt(r2));
+
+  if (q >= 1.0) {
+    return;
+  }
+  f *= (1.0 - q)*(1.0 - q);
+
+  *ax += f*dx;
+  *ay += f*dy;
+}
+
+void bhForce(bhTree* t, double x, double y, double theta, double* ax, double* ay) {
+  // a node far enough away, for the size of its bodies' box, pulls as one
+  // body at its centre of mass; distances go the short way round the torus
+  int stack[4*BH_DEPTH+4];
+  int sp = 0, c;
+  double dx, dy, ox, oy, ex, ey, gx, gy, size;
+  bhNode* nd;
+
+  stack[sp++] = 0;
+  while (sp > 0) {
+    nd = &t->nodes[stack[--sp]];
+    if (nd->m == 0.0) {
+      continue;
+    }
+    ex = (nd->hx - nd->lx)/2;
+    ey = (nd->hy - nd->ly)/2;
+    ox = fabs(wrapNear(nd->lx + ex - x, t->w));
+    oy = fabs(wrapNear(nd->ly + ey - y, t->h));
+    gx = ox > ex ? ox - ex : 0.0;
+    gy = oy > ey ? oy - ey : 0.0;
+    if (gx*gx + gy*gy > t->range*t->range) {
+      continue; // out of reach, all of it
+    }
+    dx = wrapNear(nd->cx - x, t->w);
+    dy = wrapNear(nd->cy - y, t->h);
+    size = ex > ey ? 2*ex : 2*ey;
+    // a box lying across the far side has its bodies split between both
+    // ways round, so no one centre stands for them
+    if (nd->child < 0 || (ox + ex < t->w/2 && oy + ey < t->h/2 && size*size < theta*theta*(dx*dx + dy*dy))) {
+      bhPull(dx, dy, nd->m, t->range, ax, ay); // itself included, at distance 0 it adds nothing
+      t->used++;
+      continue;
+    }
+    t->opened++;
+    for (c = 0; c < 4; c++) {
+      stack[sp++] = nd->child + c;
+    }
+  }
+}
+
+void gravityInit(spOb* a) {
+  // the fixed dx/dy it started with becomes a velocity it can change;
+  // a game's first asteroid comes before its speeds are set
+  int speed = a->speed > 0 ? a->speed : 1;
+
+  a->vx = a->dx*FIX_ONE / speed;
+  a->vy = a->dy*FIX_ONE / speed;
+  a->fx = a->fy = 0;
+  a->speed = 1; // it moves a little every tick now
+  a->mvcnt = 0;
+}
+
+int gravityAdvance(int* f, int* v, double a) {
+  // whole cells to move this tick, the rest kept for the next
+  int d;
+
+  *v += (int)lround(a*FIX_ONE);
+  *v = *v > GRAVITY_VMAX ? GRAVITY_VMAX : *v < -GRAVITY_VMAX ? -GRAVITY_VMAX : *v;
+  *f += *v;
+  d = *f >> FIX_SHIFT;
+  *f -= d * FIX_ONE; // not a shift: d is negative moving up or left
+  return d;
+}
+
+void gravityStep() {
+  // one quadtree over the asteroids, then every asteroid's pull from it,
+  // the ship's and the ufos'; spObMove does the moving
+  double ax, ay, x, y;
+  int i, k, n = 0;
+  spOb* a;
+
+  for (i = 0; i < gs->lAst; i++) {
+    a = &gs->asts[i];
+    if (!a->draw) {
+      continue;
+    }
+    gs->bodies[n].x = mod(a->x + mod(a->max_x - a->x, gs->max_x)/2, gs->max_x) + (double)a->fx/FIX_ONE;
+    gs->bodies[n].y = mod(a->y + mod(a->max_y - a->y, gs->max_y)/2, gs->max_y) + (double)a->fy/FIX_ONE;
+    gs->bodies[n].m = a->subtype == 2 ? GRAVITY_SMALL : GRAVITY_BIG;
+    gs->bodyAst[n++] = i;
+  }
+  bhBuild(&gs->tree, gs->bodies, n, gs->max_x, gs->max_y);
+  for (i = 0; i < n; i++) {
+    a = &gs->asts[gs->bodyAst[i]];
+    x = gs->bodies[i].x;
+    y = gs->bodies[i].y;
+    ax = ay = 0.0;
+    bhForce(&gs->tree, x, y, gravityTheta, &ax, &ay);
+    bhPull(wrapNear(gs->ship.x - x, gs->max_x), wrapNear(gs->ship.y - y, gs->max_y), GRAVITY_SHIP, gs->tree.range, &ax, &ay);
+    for (k = 0; k < gs->nUfo; k++) {
+      if (gs->ufos[k].draw) {
+	bhPull(wrapNear(gs->ufos[k].x - x, gs->max_x), wrapNear(gs->ufos[k].y - y, gs->max_y), GRAVITY_UFO, gs->tree.range, &ax, &ay);
+      }
+    }
+    a->dx = gravityAdvance(&a->fx, &a->vx, ax);
+    a->dy = gravityAdvance(&a->fy, &a->vy, ay);
+  }
+}
+
+/* space objects */
+
+int spObSince(spOb* spaceThing) {
+  // ticks since the ob last moved; asteroids are moved by the calendar, which doesn't count
+  if (spaceThing->type == ASTEROID) {
+    return gs->moves->now - spaceThing->moved;
+  }
+  return spaceThing->mvcnt % spaceThing->speed;
+}
+
+int lerpCell(int from, int to, double phase, int m) {
+  return mod(from + (int)floor(wrapDelta(to - from, m) * phase + 0.5), m);
+}
+
+void spObOnBattleField(spOb* spaceThing, double alpha) {
+  // draw the ob part way along its last move; an ob moving every `speed`
+  // ticks is spread over all of them rather than jumping on one
+  int h, w, x, y;
+  double phase;
+
+  getmaxyx(spaceThing->spWin, h, w);
+  phase = (spObSince(spaceThing) + alpha) / spaceThing->speed;
+  if (phase > 1.0) {
+    phase = 1.0;
+  }
+  x = lerpCell(spaceThing->lx, spaceThing->x, phase, gs->max_x);
+  y = lerpCell(spaceThing->ly, spaceThing->y, phase, gs->max_y);
+  frameBlit(&gs->frame, x, y, w, h, w, spaceThing->dOb, COLOR_PAIR(spaceThing->color), BLIT_SPRITE, spaceThing->spWin);
+}
+
+int spObVoid(spOb* spaceThing) {
+  if (spaceThing->x >= gs->max_x || spaceThing->x <= 0 || spaceThing->y >= gs->max_y || spaceThing->y <= 0) {
+    return 1;
+  }
+  return 0;
+}
+
+void asteroidSchedule(int nAst) {
+  // onto the calendar, moving speed ticks on as spObMove would have
+  spOb* a = &gs->asts[nAst];
+
+  if (gs->nMoveFree == 0) {
+    cursesEnter();
+    endwin();
+    fprintf(stderr, "astervoid: more than %d asteroids on the move calendar\n", MAX_ASTEROIDS);
+    exit(1);
+  }
+  a->mv = gs->moveFree[--gs->nMoveFree];
+  a->moved = gs->moves->now;
+  gs->moveAst[a->mv] = nAst;
+  tmSchedule(gs->moves, &gs->astMoves[a->mv], EV_MOVE, a->mv, a->speed > 0 ? a->speed : 1);
+}
+
+void asteroidRemove(int nAst) {
+  int j, i;
+  tmCancel(gs->moves, &gs->astMoves[gs->asts[nAst].mv]);
+  gs->moveAst[gs->asts[nAst].mv] = -1;
+  gs->moveFree[gs->nMoveFree++] = gs->asts[nAst].mv;
+  for (i = nAst; i < gs->lAst-1; i++) {
+    gs->asts[i] = gs->asts[i+1];
+    gs->moveAst[gs->asts[i].mv] = i;
+  }
+  gs->lAst--;
+}
+
+void missleRemove(int nMiss) {
+  int i;
+  for (i = nMiss; i < gs->lMiss; i++) {
+    gs->missles[i] = gs->missles[i+1];
+    gs->missles[i].iter=i;
+  }
+  gs->lMiss--;
+}
+
+void chestRemove(int nChest) {
+  int i;
+  for (i = nChest; i < gs->lChest; i++) {
+    gs->chests[i] = gs->chests[i+1];
+  }
+  gs->lChest--;
+}
+
+void spObStep(spOb* spaceThing) {
+  spaceThing->lx = spaceThing->x;
+  spaceThing->ly = spaceThing->y;
+  spaceThing->x = mod((spaceThing->x+spaceThing->dx), gs->max_x);
+  spaceThing->y = mod((spaceThing->y+spaceThing->dy), gs->max_y);
+  spaceThing->min_x = mod((spaceThing->min_x+spaceThing->dx), gs->max_x);
+  spaceThing->min_y = mod((spaceThing->min_y+spaceThing->dy), gs->max_y);
+  spaceThing->max_x = mod((spaceThing->max_x+spaceThing->dx), gs->max_x);
+  spaceThing->max_y = mod((spaceThing->max_y+spaceThing->dy), gs->max_y);
+}
+
+void spObMove(spOb* spaceThing) {
+  
+  spaceThing->mvcnt++;
+  spaceThing->px = spaceThing->x;
+  spaceThing->py = spaceThing->y;
+  
+  if ((spaceThing->mvcnt % spaceThing->speed) == 0) {  
+    spObStep(spaceThing);
+  }
+
+  if (spaceThing->type == MISSLE) {
+    if (spObVoid(spaceThing)==1) {
+      missleRemove(spaceThing->iter);
+    }
+  }
+}
+
+void asteroidMove(tmEvent* ev) {
+  // its tick has come round: one step, and the next one booked
+  spOb* a = &gs->asts[gs->moveAst[ev->arg]];
+
+  a->px = a->x;
+  a->py = a->y;
+  spObStep(a);
+  a->moved = gs->moves->now;
+  gs->moveSettle[gs->nMoveSettle++] = ev->arg;
+  gs->perf.astSteps++;
+  tmSchedule(gs->moves, ev, EV_MOVE, ev->arg, a->speed);
+}
+
+void asteroidsMove() {
+  // only the asteroids due this tick are moved, and the ones that moved
+  // last tick caught up; the rest cost nothing until their tick comes
+  int k, i;
+
+  for (k = 0; k < gs->nMoveSettle; k++) {
+    if ((i = gs->moveAst[gs->moveSettle[k]]) >= 0) {
+      gs->asts[i].px = gs->asts[i].x;
+      gs->asts[i].py = gs->asts[i].y;
+      gs->perf.astSettled++;
+    }
+  }
+  gs->nMoveSettle = 0;
+  tmAdvance(gs->moves, asteroidMove);
+}
+
+/*
+ * Initialize Spacebound Objects
+ */
+
+static void shipInit() {
+  gs->ship.type = SHIP;
+  gs->ship.iter = 0;
+  gs->ship.mvcnt = 0;
+  gs->ship.dx = -1;
+  gs->ship.dy = 0;
+  gs->ship.dS = 0;
+  gs->ship.x = gs->max_x/2;
+  gs->ship.y = gs->max_y/2;
+  gs->ship.px = gs->ship.x;
+  gs->ship.py = gs->ship.y;
+  gs->ship.lx = gs->ship.x;
+  gs->ship.ly = gs->ship.y;
+  gs->ship.max_x = gs->ship.x+1;
+  gs->ship.min_x = gs->ship.x;
+  gs->ship.max_y = gs->ship.y;
+  gs->ship.min_y = gs->ship.y;
+  gs->ship.drift = 0;
+  gs->ship.speed = 3;
+  gs->ship.color = CYAN;
+  gs->ship.score = 0;
+  gs->ship.lives = 3;
+  gs->ship.dOb = dShips[0];
+  gs->ship.spWin = shapePad(1, 2);
+}
+
+static void ufoInit(int k) {
+  spOb* u = &gs->ufos[k];
+
+  u->type = UFO;
+  u->iter = k;
+  u->mvcnt = 0;
+  u->speed = gs->stats.ufoSpeed;
+  if ((random() % 2) == 0) {
+    u->color = RED;
+  } else {
+    u->color = GREEN;
+  }
+  //ufo.score = 0;
+  u->lives = 3;
+  u->dy = 0;
+  if ((random() % 2) == 0) {
+    u->x = gs->max_x-4;
+    u->dx = -1;
+  } else {
+    u->x = 1;
+    u->dx = 1;
+  }
+  u->y = (random() % gs->max_y-1)+3;
+  u->px = u->x;
+  u->py = u->y;
+  u->lx = u->x;
+  u->ly = u->y;
+  u->max_x = u->x+5;
+  u->min_x = u->x;
+  u->max_y = u->y;
+  u->min_y = u->y;
+  u->subtype = k % 3 == 2; // every third one hunts the ship, the rest asteroids
+  u->draw = 1;
+  u->dOb = dUfo[0];
+  
+  u->spWin = shapePad(1, u->max_x-u->min_x);
+}
+
+static void asteroidInit(int nAst) {
   
-  sprintf (strStatus, "Score: %2.7d/%2.7d Asteroids: %2.7d Rank: %s Ships: %d", ship.score, ufo.score, lAst, stats.rank, ship.lives);
+  gs->asts[nAst].type = ASTEROID;
+  gs->asts[nAst].iter = nAst;
+  gs->asts[nAst].mvcnt = 0;
+  gs->asts[nAst].speed = gs->stats.astSpeed;
+  gs->asts[nAst].subtype = 5;
+  gs->asts[nAst].draw = 1;
+  gs->asts[nAst].slot = -1;
+  int tmp = 0;
+  tmp = (random() % 5);
+
+  if (tmp == 4) {
+    gs->asts[nAst].x = (random() % gs->max_x-4)+1;
+    gs->asts[nAst].y = 2;
+    gs->asts[nAst].dy = 1;
+    gs->asts[nAst].dx = -1;
+  } else if (tmp == 3) {
+    gs->asts[nAst].x = 2;
+    gs->asts[nAst].y = (random() % gs->max_y-4)+1;
+    gs->asts[nAst].dx = 1;
+    gs->asts[nAst].dy = -1;
+  } else if (tmp == 2) {
+    gs->asts[nAst].x = gs->max_x-4;
+    gs->asts[nAst].y = (random() % gs->max_y-4)+1;
+    gs->asts[nAst].dx = -1;
+    gs->asts[nAst].dy = 1;
+  } else {
+    gs->asts[nAst].x = (random() % gs->max_x-4)+1;
+    gs->asts[nAst].y = gs->max_y-4;
+    gs->asts[nAst].dy = -1;
+    gs->asts[nAst].dx = 1;
+  }
+
+  gs->asts[nAst].px = gs->asts[nAst].x;
+  gs->asts[nAst].py = gs->asts[nAst].y;
+  gs->asts[nAst].lx = gs->asts[nAst].x;
+  gs->asts[nAst].ly = gs->asts[nAst].y;
+  gs->asts[nAst].max_x = gs->asts[nAst].x+9;
+  gs->asts[nAst].max_y = gs->asts[nAst].y+4;
+  //asts[nAst].dOb = dAst5[random() % 2][random() % 2];
+  gs->asts[nAst].dOb = dAst5[random() % 3][0];
+  gs->asts[nAst].color = YELLOW;
+
+  gs->asts[nAst].spWin = shapePad(5, 10);
+  if (gravity) {
+    gravityInit(&gs->asts[nAst]);
+  }
+  asteroidSchedule(nAst);
+}
+
+void asteroidSplit(int nAst) {
+  // the parent goes first, so the piece takes its room even at the cap
+  spOb parent = gs->asts[nAst];
+
+  asteroidRemove(nAst);
+  gs->asts[gs->lAst].type = ASTEROID;
+  gs->asts[gs->lAst].speed = parent.speed;
+  gs->asts[gs->lAst].mvcnt = 0;
+  gs->asts[gs->lAst].subtype = 2;
+  gs->asts[gs->lAst].iter = gs->lAst;
+  gs->asts[gs->lAst].draw = 1;
+  gs->asts[gs->lAst].slot = -1;
+  gs->asts[gs->lAst].x = parent.x+(random() % 6);
+  gs->asts[gs->lAst].y = parent.y+(random() % 6);
+  gs->asts[gs->lAst].px = gs->asts[gs->lAst].x;
+  gs->asts[gs->lAst].py = gs->asts[gs->lAst].y;
+  gs->asts[gs->lAst].lx = gs->asts[gs->lAst].x;
+  gs->asts[gs->lAst].ly = gs->asts[gs->lAst].y;
+  gs->asts[gs->lAst].max_x = gs->asts[gs->lAst].x+3;
+  gs->asts[gs->lAst].max_y = gs->asts[gs->lAst].y+2;
+  gs->asts[gs->lAst].color = YELLOW;
+  gs->asts[gs->lAst].dx = parent.dx;
+  gs->asts[gs->lAst].dy = parent.dy;
+  gs->asts[gs->lAst].dOb = dAst2[random() % 2][0];
+  
+  gs->asts[gs->lAst].spWin = shapePad(3, 4);
+  if (gravity) {
+    // the pieces fly on as the parent was going
+    gs->asts[gs->lAst].vx = parent.vx;
+    gs->asts[gs->lAst].vy = parent.vy;
+    gs->asts[gs->lAst].fx = gs->asts[gs->lAst].fy = 0;
+  }
+  asteroidSchedule(gs->lAst);
+  gs->lAst++;
+}
+
+void chestInit(int nChest) {
+  gs->chests[nChest].dOb = "$";
+  gs->chests[nChest].mvcnt = 0;
+  gs->chests[nChest].iter = nChest;
+  gs->chests[nChest].type = CHEST;
+  gs->chests[nChest].color = BLUE;
+  gs->chests[nChest].speed = 3;
+  gs->chests[nChest].draw=1;
+
+  int tmp = 0;
+  tmp = (random() % 5);
+  
+  if (tmp == 4) {
+    gs->chests[nChest].x = (random() % gs->max_x-2)+1;
+    gs->chests[nChest].y = 1;
+    gs->chests[nChest].dx = -1;
+    gs->chests[nChest].dy = 1;
+  } else if (tmp == 3) {
+    gs->chests[nChest].x = 1;
+    gs->chests[nChest].y = (random() % gs->max_y-2)+1;
+    gs->chests[nChest].dx = 1;
+    gs->chests[nChest].dy = -1;
+  } else if (tmp == 2) {
+    gs->chests[nChest].x = gs->max_x-1;
+    gs->chests[nChest].y = (random() % gs->max_y-2)+1;
+    gs->chests[nChest].dx = -1;
+    gs->chests[nChest].dy = 1;
+  } else {
+    gs->chests[nChest].x = (random() % gs->max_x-2)+1;
+    gs->chests[nChest].y = gs->max_y - 1;
+    gs->chests[nChest].dx = 1;
+    gs->chests[nChest].dy = -1;
+  }
+
+  gs->chests[nChest].px = gs->chests[nChest].x;
+  gs->chests[nChest].py = gs->chests[nChest].y;
+  gs->chests[nChest].lx = gs->chests[nChest].x;
+  gs->chests[nChest].ly = gs->chests[nChest].y;
+  gs->chests[nChest].max_x = gs->chests[nChest].x;
+  gs->chests[nChest].max_y = gs->chests[nChest].y;
+
+  gs->chests[nChest].spWin = shapePad(1, 1);
+}
+
+static void ufoMissleInit(int nMiss, spOb* u, spOb* t) {
+  // fired from u straight at t's box
+
+  gs->missles[nMiss].type = MISSLE;
+  gs->missles[nMiss].dOb = "+";
+  gs->missles[nMiss].iter = nMiss;
+  gs->missles[nMiss].mvcnt = 0;
+  gs->missles[nMiss].x = u->x+2;
+  gs->missles[nMiss].y = u->y;
+  gs->missles[nMiss].px = gs->missles[nMiss].x;
+  gs->missles[nMiss].py = gs->missles[nMiss].y;
+  gs->missles[nMiss].lx = gs->missles[nMiss].x;
+  gs->missles[nMiss].ly = gs->missles[nMiss].y;
+  gs->missles[nMiss].max_x = gs->missles[nMiss].x;
+  gs->missles[nMiss].max_y = gs->missles[nMiss].y;
+  gs->missles[nMiss].subtype = 1;
+  gs->missles[nMiss].draw = 1;
+  gs->missles[nMiss].speed = 1;
+
+  if ((u->x == t->x) || (u->x >= t->x && u->x <= t->max_x)) {
+    gs->missles[nMiss].dx = 0;
+    u->dS = 0;
+  } else if (u->x > t->x) {
+    gs->missles[nMiss].dx = -MISSLE_STEP;
+    u->dS = 1;
+  } else {
+    gs->missles[nMiss].dx = MISSLE_STEP;
+    u->dS = 2;
+  }
+
+  if ((u->y == t->y) || (u->y >= t->y && u->y <= t->max_y)) {
+    gs->missles[nMiss].dy = 0;
+    
+  } else if (u->y > t->y) {
+    gs->missles[nMiss].dy = -MISSLE_STEP;
+  } else {
+    gs->missles[nMiss].dy = MISSLE_STEP;
+  }
+  
+  gs->missles[nMiss].spWin = shapePad(1, 1);
+}
+
+static void missleInit(int nMiss) {
+  gs->missles[nMiss].dOb = "+";
+  gs->missles[nMiss].type = MISSLE;
+  gs->missles[nMiss].iter = nMiss;
+  gs->missles[nMiss].mvcnt = 0;
+  gs->missles[nMiss].subtype = 0;
+  gs->missles[nMiss].draw = 1;
+  gs->missles[nMiss].speed = 1;
+  gs->missles[nMiss].x = gs->ship.x;
+  gs->missles[nMiss].y = gs->ship.y;
+  gs->missles[nMiss].px = gs->missles[nMiss].x;
+  gs->missles[nMiss].py = gs->missles[nMiss].y;
+  gs->missles[nMiss].lx = gs->missles[nMiss].x;
+  gs->missles[nMiss].ly = gs->missles[nMiss].y;
+  gs->missles[nMiss].max_x = gs->missles[nMiss].x;
+  gs->missles[nMiss].max_y = gs->missles[nMiss].y;
+  gs->missles[nMiss].dx = dxShips[gs->ship.dS]*MISSLE_STEP;
+  gs->missles[nMiss].dy = dyShips[gs->ship.dS]*MISSLE_STEP;
+  gs->missles[nMiss].color = GREEN;
+  gs->missles[nMiss].spWin = shapePad(1, 1);
+}
+
+/* ufo fleet */
+
+int ufoFleetSize() {
+  return gs->stats.level < MAX_UFOS ? gs->stats.level : MAX_UFOS;
+}
+
+int missleCap() {
+  // the ship's and the fleet's, shared
+  return MISSLES_BASE + (gs->nUfo-1)*MISSLES_PER_UFO;
+}
+
+void ufoFleetGrow() {
+  while (gs->nUfo < ufoFleetSize()) {
+    ufoInit(gs->nUfo++);
+  }
+}
+
+int gridCol(int x) {
+  int c = x*GRID_COLS/gs->max_x;
+  return c < 0 ? 0 : c >= GRID_COLS ? GRID_COLS-1 : c;
+}
+
+int gridRow(int y) {
+  int r = y*GRID_ROWS/gs->max_y;
+  return r < 0 ? 0 : r >= GRID_ROWS ? GRID_ROWS-1 : r;
+}
+
+void targetGridBuild() {
+  // counting sort of the live asteroids by cell; a cell's indexes end up
+  // ascending, from gridStart[c] up to gridStart[c+1]
+  int* start = gs->gridStart;
+  int i, c;
+
+  memset(start, 0, (GRID_COLS*GRID_ROWS+1)*sizeof(int));
+  for (i = 0; i < gs->lAst; i++) {
+    gs->asts[i].color = YELLOW; // this tick's targets go red again below
+    if (gs->asts[i].draw) {
+      start[gridRow(gs->asts[i].y)*GRID_COLS + gridCol(gs->asts[i].x)]++;
+    }
+  }
+  for (c = 1; c <= GRID_COLS*GRID_ROWS; c++) {
+    start[c] += start[c-1];
+  }
+  for (i = gs->lAst-1; i >= 0; i--) {
+    if (gs->asts[i].draw) {
+      gs->gridItems[--start[gridRow(gs->asts[i].y)*GRID_COLS + gridCol(gs->asts[i].x)]] = i;
+    }
+  }
+  gs->perf.aimGrids++;
+}
+
+int targetNearest(spOb* u) {
+  // the asteroid a full scan would pick (nearest top left corner, lowest
+  // index on a tie), looking ring by ring out from u's cell and stopping
+  // once nothing outside the rings seen can be as close
+  double cw = (double)gs->max_x/GRID_COLS, ch = (double)gs->max_y/GRID_ROWS;
+  double reach, d;
+  int cx = gridCol(u->x), cy = gridRow(u->y);
+  int r, x, y, k, i, best = -1, open;
+  long dx, dy, dist, bestDist = 0;
+
+  for (r = 0; ; r++) {
+    for (y = cy-r; y <= cy+r; y++) {
+      if (y < 0 || y >= GRID_ROWS) {
+	continue;
+      }
+      // inside rows only have their two end cells left to look at
+      for (x = cx-r; x <= cx+r; x += (y == cy-r || y == cy+r || r == 0) ? 1 : 2*r) {
+	if (x < 0 || x >= GRID_COLS) {
+	  continue;
+	}
+	for (k = gs->gridStart[y*GRID_COLS + x]; k < gs->gridStart[y*GRID_COLS + x + 1]; k++) {
+	  i = gs->gridItems[k];
+	  dx = u->x - gs->asts[i].x;
+	  dy = u->y - gs->asts[i].y;
+	  dist = dx*dx + dy*dy;
+	  if (best < 0 || dist < bestDist || (dist == bestDist && i < best)) {
+	    best = i;
+	    bestDist = dist;
+	  }
+	  gs->perf.aimScans++;
+	}
+      }
+    }
+    // how far the unseen cells are, on the sides the grid goes on
+    open = 0;
+    reach = 1e9;
+    if (cx-r > 0) {
+      d = u->x - (cx-r)*cw;
+      reach = d < reach ? d : reach;
+      open = 1;
+    }
+    if (cx+r < GRID_COLS-1) {
+      d = (cx+r+1)*cw - u->x;
+      reach = d < reach ? d : reach;
+      open = 1;
+    }
+    if (cy-r > 0) {
+      d = u->y - (cy-r)*ch;
+      reach = d < reach ? d : reach;
+      open = 1;
+    }
+    if (cy+r < GRID_ROWS-1) {
+      d = (cy+r+1)*ch - u->y;
+      reach = d < reach ? d : reach;
+      open = 1;
+    }
+    if (!open || (best >= 0 && bestDist < reach*reach)) {
+      break;
+    }
+  }
+  gs->perf.aims++;
+  return best;
+}
+
+void ufoFleet() {
+  // move the fleet, then aim everything that fires this tick in one pass
+  // over a grid of the asteroids rather than a full scan per shooter
+  int shooters[MAX_UFOS];
+  int n = 0, hunting = 0, i, k, a;
+  spOb *u, *t;
+
+  for (k = 0; k < gs->nUfo; k++) {
+    u = &gs->ufos[k];
+    if (!u->draw) {
+      continue;
+    }
+    spObMove(u);
+    if (gs->lMiss + n < missleCap() && (random() % u->speed) == 0) {
+      shooters[n++] = k;
+      hunting |= u->subtype == 0;
+    }
+    u->dOb = dUfo[u->dS];
+  }
+  if (hunting && gs->lAst > 0) {
+    targetGridBuild();
+  }
+  for (i = 0; i < n; i++) {
+    u = &gs->ufos[shooters[i]];
+    t = &gs->ship;
+    if (u->subtype == 0 && gs->lAst > 0 && (a = targetNearest(u)) >= 0) {
+      t = &gs->asts[a];
+      t->color = RED;
+    }
+    ufoMissleInit(gs->lMiss++, u, t);
+    u->dOb = dUfo[u->dS];
+  }
+}
+
+/* BATTLEFIELD */
+
+static void starFieldInit() {
+  gs->wEmpty = newpad(gs->max_y, gs->max_x);
+
+  gs->wStarField = newpad(1, 1);
+  wattrset(gs->wStarField, COLOR_PAIR(YELLOW));
+  waddstr(gs->wStarField, "*");
+}
+
+static void starFieldSeed() {
+  int i,j;
+
+  werase(gs->wEmpty);
+  for (i = 0; i<gs->max_x; i++) {
+    j = random() % gs->max_y;
+    copywin(gs->wStarField, gs->wEmpty,0,0,j,i,j,i,0);
+  }
+  box(gs->wEmpty,0,0);
+}
+
+static void battleFieldInit() {
+  gs->wBattleField = newwin(gs->max_y, gs->max_x, 0, 0);
+  wclear(gs->wBattleField);
+}
+
+/* resize */
+
+static void starFieldResize(int oy, int ox) {
+  // keep the stars we have, only roll them for the newly exposed strips
+  WINDOW* wOld = gs->wEmpty;
+  int i, j;
+
+  gs->wEmpty = newpad(gs->max_y, gs->max_x);
+  wclear(gs->wEmpty);
+  copywin(wOld, gs->wEmpty, 0, 0, 0, 0, (oy < gs->max_y ? oy : gs->max_y)-1, (ox < gs->max_x ? ox : gs->max_x)-1, 0);
+  delwin(wOld);
+
+  // the old right and bottom edges are open space now
+  if (gs->max_x > ox) {
+    for (j = 0; j < oy && j < gs->max_y; j++) {
+      mvwaddch(gs->wEmpty, j, ox-1, ' ');
+    }
+  }
+  if (gs->max_y > oy) {
+    for (i = 0; i < ox && i < gs->max_x; i++) {
+      mvwaddch(gs->wEmpty, oy-1, i, ' ');
+    }
+    for (i = 0; i < ox && i < gs->max_x; i++) {
+      if (random() % gs->max_y < gs->max_y - oy) {
+	j = oy + random() % (gs->max_y - oy);
+	copywin(gs->wStarField, gs->wEmpty,0,0,j,i,j,i,0);
+      }
+    }
+  }
+  for (i = ox; i < gs->max_x; i++) {
+    j = random() % gs->max_y;
+    copywin(gs->wStarField, gs->wEmpty,0,0,j,i,j,i,0);
+  }
+  box(gs->wEmpty,0,0);
+}
+
+int remapCell(int v, int from, int to) {
+  return mod(v, from) * to / from;
+}
+
+void spObRemap(spOb* spaceThing, int oy, int ox) {
+  // scale the ob into the new field, keeping the size of its box
+  int w = mod(spaceThing->max_x - spaceThing->x, ox);
+  int h = mod(spaceThing->max_y - spaceThing->y, oy);
+
+  spaceThing->x = remapCell(spaceThing->x, ox, gs->max_x);
+  spaceThing->y = remapCell(spaceThing->y, oy, gs->max_y);
+  spaceThing->min_x = spaceThing->x;
+  spaceThing->min_y = spaceThing->y;
+  spaceThing->max_x = mod(spaceThing->x + w, gs->max_x);
+  spaceThing->max_y = mod(spaceThing->y + h, gs->max_y);
+  spaceThing->px = spaceThing->lx = spaceThing->x;
+  spaceThing->py = spaceThing->ly = spaceThing->y;
+}
+
+void gameResize() {
+  struct winsize ws;
+  int oy = gs->max_y, ox = gs->max_x, i;
+
+  if (ioctl(gs->tty, TIOCGWINSZ, &ws) < 0 || ws.ws_row < 3 || ws.ws_col < 3) {
+    return;
+  }
+  if (ws.ws_row == gs->max_y && ws.ws_col == gs->max_x) {
+    return;
+  }
+  cursesEnter();
+  resizeterm(ws.ws_row, ws.ws_col);
+  gs->scrmax_y = gs->max_y = ws.ws_row;
+  gs->scrmax_x = gs->max_x = ws.ws_col;
+
+  wresize(gs->wBattleField, gs->max_y, gs->max_x);
+  starFieldResize(oy, ox);
+  frameInit(&gs->frame, gs->max_x, gs->max_y, MAX_BLITS);
+  frameBackground(&gs->frame, gs->wEmpty);
+
+  spObRemap(&gs->ship, oy, ox);
+  for (i = 0; i < gs->nUfo; i++) {
+    spObRemap(&gs->ufos[i], oy, ox);
+  }
+  for (i = 0; i < gs->lAst; i++) {
+    spObRemap(&gs->asts[i], oy, ox);
+  }
+  for (i = 0; i < gs->lMiss; i++) {
+    spObRemap(&gs->missles[i], oy, ox);
+  }
+  for (i = 0; i < gs->lChest; i++) {
+    spObRemap(&gs->chests[i], oy, ox);
+  }
+  for (i = 0; i < MAX_EFFECTS; i++) {
+    gs->effects[i].x = remapCell(gs->effects[i].x, ox, gs->max_x);
+    gs->effects[i].y = remapCell(gs->effects[i].y, oy, gs->max_y);
+  }
+  clearok(curscr, TRUE);
+  gs->shown = -1;
+  cursesLeave();
+}
+
+void wakeUp() {
+  // safe from a signal handler; a full pipe is already a wake up
+  char c = 0;
+
+  if (write(wakeFds[1], &c, 1) < 0) {
+    return;
+  }
+}
+
+static void handleResize(int sig) {
+  resized = 1;
+  wakeUp();
+}
+
+static void handleInterrupt(int sig) {
+  // every session winds up as if its terminal had gone, putting it back on the way
+  int i;
+
+  for (i = 0; i < nSessions; i++) {
+    atomic_store(&sessions[i].hangup, 1);
+  }
+  wakeUp();
+}
+
+static void handleStop(int sig) {
+  // the frame loop stops us once the writer is out of the way, see termStop
+  stopping = 1;
+  wakeUp();
+}
+
+/* title screen */
+
+static void titleScreenInit() {  
+  gs->wTitleScreen = newpad(gs->max_y, gs->max_x);
+  wclear(gs->wTitleScreen);
+
+  /* big title */
+  gs->wTitleText = newpad(3, 45);
+  wclear(gs->wTitleText);
+  wattrset(gs->wTitleText, COLOR_PAIR(YELLOW));
+  waddstr(gs->wTitleText, dTitle);
+
+  /* info text */
+  gs->wStartText = newpad(1, 20);
+  wclear(gs->wStartText);
+  wattrset(gs->wStartText, COLOR_PAIR(RED));
+  waddstr(gs->wStartText, dStart);
+}
+
+void titleScreenDisplay() {
+
+  int x, y;
+
+  x = (gs->max_x / 2) - (45 / 2);
+  y = 0;
+  drawOnBattleField(gs->wTitleText,dTitle,COLOR_PAIR(YELLOW),x,y,x+44,y+2);
+
+  x = (gs->max_x / 2) - (20 / 2);
+  y = gs->max_y - 2;
+  drawOnBattleField(gs->wStartText,dStart,COLOR_PAIR(RED),x,y,x+19,y);
+}
+
+
+/* gameover  */
+
+static void gameOverInit() {
+  gs->wGameOver = newpad(13, 31);
+  wclear(gs->wGameOver);
+  wattrset(gs->wGameOver, COLOR_PAIR(GREEN));
+  waddstr(gs->wGameOver, dGameOver);
+
+  /* info text */
+  gs->wRestartText = newpad(1, 22);
+  wclear(gs->wRestartText);
+  wattrset(gs->wRestartText, COLOR_PAIR(RED));
+  waddstr(gs->wRestartText, dRestart);
+}
+
+void gameOverDisplay() {
+  int x = (gs->max_x / 2) - (31 / 2);
+  int y = (gs->max_y / 2) - (13 / 2);
+  drawOnBattleField(gs->wGameOver,dGameOver,COLOR_PAIR(GREEN),x,y,x+30,y+12);
+
+  x = (gs->max_x / 2) - (22 / 2);
+  y = gs->max_y - 2;
+  drawOnBattleField(gs->wRestartText,dRestart,COLOR_PAIR(RED),x,y,x+21,y);
+}
+
+
+/* paused */
+
+static void gamePausedInit() {
+  gs->wGamePaused = newpad(10, 41);
+  wclear(gs->wGamePaused);
+  wattrset(gs->wGamePaused, COLOR_PAIR(GREEN));
+  waddstr(gs->wGamePaused, dPaused);
+}
+
+void gamePausedDisplay() {
+  int x = (gs->max_x / 2) - (41 / 2);
+  int y = (gs->max_y / 2) - (10 / 2);
+  drawOnBattleField(gs->wGamePaused,dPaused,COLOR_PAIR(GREEN),x,y,x+40,y+9);
+}
+
+
+/* Status Bar  */
+
+void statusInit() {
+  gs->wStatus = newpad(1, 70);
+  wclear(gs->wStatus);
+}
+
+void statusDisplay() {
   
-  wclear(wStatus);
-  wattrset(wStatus, COLOR_PAIR(RED));
-  waddstr(wStatus, strStatus);
+  sprintf (gs->strStatus, "Score: %2.7d/%2.7d Asteroids: %2.7d Rank: %s Ships: %d", gs->ship.score, gs->ufoScore, gs->lAst, gs->stats.rank, gs->ship.lives);
+
+  drawOnBattleField(gs->wStatus,gs->strStatus,COLOR_PAIR(RED),2,1,70,1);
+}
+
+
+/* terminal writer */
+
+void termOpen() {
+  // curses draws into a file rather than the terminal, so drawing never
+  // blocks; the writer thread sends the file on. Curses cannot set the
+  // terminal's modes through a file either, so they are set here
+  if ((gs->out = tmpfile()) == NULL) {
+    perror("tmpfile");
+    exit(1);
+  }
+  if (gs->tty >= 0 && tcgetattr(gs->tty, &gs->ttyModes) == 0) {
+    gs->ttyPlay = gs->ttyModes;
+    gs->ttyPlay.c_lflag &= ~(ICANON | ECHO); // cbreak, noecho
+    gs->ttyPlay.c_iflag &= ~ICRNL; // nonl
+    gs->ttyPlay.c_cc[VMIN] = 1;
+    gs->ttyPlay.c_cc[VTIME] = 0;
+    tcsetattr(gs->tty, TCSANOW, &gs->ttyPlay);
+    gs->ttyRaw = 1;
+  }
+}
+
+void termRestore() {
+  // the session is over and all it drew is out
+  if (gs->ttyRaw) {
+    tcsetattr(gs->tty, TCSANOW, &gs->ttyModes);
+  }
+  close(gs->tty);
+  gs->tty = -1;
+}
+
+long monoNs() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec*1000000000L + now.tv_nsec;
+}
+
+long termStalled(gSession* s) {
+  // stalls so far, one still going included
+  long since = atomic_load(&s->stallSince);
+
+  return s->perf.stallNs + (since ? monoNs() - since : 0);
+}
+
+long termWorstStall(gSession* s) {
+  long since = atomic_load(&s->stallSince);
+
+  return since && monoNs() - since > s->perf.worstStall ? monoNs() - since : s->perf.worstStall;
+}
+
+void termStallEnd() {
+  long ns = monoNs() - atomic_load(&gs->stallSince);
+
+  gs->perf.stalls++;
+  gs->perf.stallNs += ns;
+  if (ns > gs->perf.worstStall) {
+    gs->perf.worstStall = ns;
+  }
+  atomic_store(&gs->stallSince, 0);
+}
+
+int termSend() {
+  // as much of what curses wrote as the terminal takes without blocking;
+  // 1 once it has the lot. writerLock held
+  char buf[4096];
+  int fd = fileno(gs->out);
+  int done;
+  off_t end;
+  long n;
+
+  while ((end = lseek(fd, 0, SEEK_CUR)) > gs->outSent) {
+    n = end - gs->outSent < (off_t)sizeof(buf) ? end - gs->outSent : (off_t)sizeof(buf);
+    if ((n = pread(fd, buf, n, gs->outSent)) <= 0) {
+      return 0;
+    }
+    if ((n = write(gs->tty, buf, n)) < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      if (errno == EAGAIN) {
+	if (atomic_load(&gs->stallSince) == 0) {
+	  atomic_store(&gs->stallSince, monoNs());
+	}
+	return 0;
+      }
+      // gone; what is left goes nowhere and the session winds up
+      gs->outSent = end;
+      atomic_store(&gs->hangup, 1);
+      wakeUp();
+      break;
+    }
+    gs->outSent += n;
+    gs->perf.termBytes += n;
+  }
+  if (atomic_load(&gs->stallSince)) {
+    termStallEnd();
+  }
+  // all out, so the file starts over, unless curses got more in meanwhile
+  cursesEnter();
+  done = lseek(fd, 0, SEEK_CUR) == gs->outSent;
+  if (done && ftruncate(fd, 0) == 0) {
+    lseek(fd, 0, SEEK_SET);
+    gs->outSent = 0;
+  }
+  cursesLeave();
+  return done;
+}
+
+int termPass() {
+  // the last frame out first, then the newest staged one; 1 while the
+  // terminal holds things up. writerLock held
+  int sent;
+
+  if (!termSend()) {
+    return 1;
+  }
+  // looked at under cursesLock, so never a frame after the session's endwin
+  cursesEnter();
+  sent = gs->live && !atomic_load(&gs->hangup) && atomic_exchange(&gs->framePending, 0);
+  if (sent) {
+    doupdate();
+  }
+  cursesLeave();
+  if (sent) {
+    gs->perf.framesSent++;
+    if (!termSend()) {
+      return 1;
+    }
+  }
+  if (!gs->live) {
+    termRestore();
+  }
+  return 0;
+}
+
+void* writerLoop(void* arg) {
+  // one thread sends every session's frames, so a terminal that stops
+  // reading holds up only its own
+  struct pollfd pfd[nSessions+1];
+  char buf[64];
+  sigset_t all;
+  int i, n;
+
+  // signals are the frame loop's, which may be waiting on writerLock
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, NULL);
+  pfd[0].fd = writerFds[0];
+  pfd[0].events = POLLIN;
+  while (1) {
+    while (read(writerFds[0], buf, sizeof(buf)) > 0) {
+    }
+    n = 1;
+    pthread_mutex_lock(&writerLock);
+    for (i = 0; i < nSessions; i++) {
+      gs = &sessions[i];
+      if (gs->tty >= 0 && termPass()) {
+	pfd[n].fd = gs->tty;
+	pfd[n++].events = POLLOUT;
+      }
+    }
+    pthread_mutex_unlock(&writerLock);
+    poll(pfd, n, -1);
+  }
+  return NULL;
+}
+
+void writerStart() {
+  if (pipe(writerFds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+  fcntl(writerFds[0], F_SETFL, O_NONBLOCK);
+  fcntl(writerFds[1], F_SETFL, O_NONBLOCK);
+  pthread_create(&writerThread, NULL, writerLoop, NULL);
+}
+
+void termDrain(gSession* s) {
+  // on the way out: the terminal gets a little while to take the rest
+  struct pollfd pfd;
+  int tries;
+
+  pthread_mutex_lock(&writerLock);
+  gs = s;
+  if (gs->tty >= 0) {
+    for (tries = 0; !termSend() && tries < TERM_DRAIN_TRIES; tries++) {
+      pfd.fd = gs->tty;
+      pfd.events = POLLOUT;
+      poll(&pfd, 1, TERM_DRAIN_MS);
+    }
+    if (atomic_load(&gs->stallSince)) {
+      termStallEnd(); // it never caught up
+    }
+    termRestore();
+  }
+  pthread_mutex_unlock(&writerLock);
+}
+
+void termFlushAll() {
+  // all of the file out, however long the terminal takes. writerLock held
+  struct pollfd pfd;
+
+  while (gs->tty >= 0 && !termSend() && !atomic_load(&gs->hangup)) {
+    pfd.fd = gs->tty;
+    pfd.events = POLLOUT;
+    poll(&pfd, 1, -1);
+  }
+}
+
+void termCap(char* cap) {
+  // a terminfo string to the terminal, after whatever is already in the file
+  if (cap == NULL || cap == (char*)-1) {
+    return;
+  }
+  cursesEnter();
+  fputs(cap, gs->out);
+  fflush(gs->out);
+  cursesLeave();
+  termFlushAll();
+}
+
+void termStop() {
+  // ^Z: the shell gets its terminal back while we are stopped, and a
+  // whole redraw once we carry on. The writer is held off throughout, so
+  // nothing of ours lands mid-sequence or after the shell has the terminal
+  struct sigaction stop, ours;
+
+  pthread_mutex_lock(&writerLock);
+  termCap(caExit);
+  if (gs->ttyRaw) {
+    tcsetattr(gs->tty, TCSANOW, &gs->ttyModes);
+  }
+  memset(&stop, 0, sizeof(stop));
+  stop.sa_handler = SIG_DFL;
+  sigaction(SIGTSTP, &stop, &ours);
+  raise(SIGTSTP);
+  sigaction(SIGTSTP, &ours, NULL);
+  if (gs->ttyRaw) {
+    tcsetattr(gs->tty, TCSANOW, &gs->ttyPlay);
+  }
+  termCap(caEnter);
+  pthread_mutex_unlock(&writerLock);
+  repaint = 1;
+}
+
+/* instrumentation */
+
+long tsNs(struct timespec* a, struct timespec* b) {
+  return (a->tv_sec - b->tv_sec)*1000000000L + (a->tv_nsec - b->tv_nsec);
+}
+
+void instrDump(FILE* fp) {
+  fprintf(fp,"\n");
+  fprintf(fp,"frames: %ld drawn, %ld ticks, %ld deadlines missed\n", gs->perf.frames, gs->perf.ticks, gs->perf.missed);
+  fprintf(fp,"  frame %.3f ms mean, %.3f ms worst; tick %.3f ms worst\n", gs->perf.frames ? gs->perf.frameNs/1e6/gs->perf.frames : 0.0, gs->perf.worstFrame/1e6, gs->perf.worstTick/1e6);
+  fprintf(fp,"timer wheel: tick %lu, pending %d/%d/%d/%d by level\n", gs->wheel.now, gs->wheel.pending[0], gs->wheel.pending[1], gs->wheel.pending[2], gs->wheel.pending[3]);
+  fprintf(fp,"  scheduled %ld, cancelled %ld, fired %ld, cascaded %ld\n", gs->wheel.scheduled, gs->wheel.cancelled, gs->wheel.fired, gs->wheel.cascaded);
+  fprintf(fp,"collisions: %ld events, %ld applied, %ld duplicates, %ld dropped\n", gs->perf.hits, gs->perf.hitsApplied, gs->perf.hits - gs->perf.hitsApplied, gs->perf.hitsDropped);
+  fprintf(fp,"id raster: %ld cells painted, %ld box tests left of %ld by scan\n", gs->perf.rasterCells, gs->perf.rasterTests, gs->perf.scanTests);
+  fprintf(fp,"coherence: %ld of %ld asteroids changed cells a tick, %ld touching pairs kept\n", gs->perf.astMoved, gs->perf.astSeen, gs->perf.pairsKept);
+  fprintf(fp,"move calendar: %ld asteroid steps and %ld catch ups for %ld asteroid ticks\n", gs->perf.astSteps, gs->perf.astSettled, gs->perf.astSeen);
+  fprintf(fp,"targeting: %ld aims, %.1f asteroids looked at each, %ld grids built\n", gs->perf.aims, gs->perf.aims ? (double)gs->perf.aimScans/gs->perf.aims : 0.0, gs->perf.aimGrids);
+  fprintf(fp,"blits: %.0f cells written a frame, %.0f as whole rectangles; %d sprites in %d runs\n", gs->renderFrames ? (double)gs->frame.cellsWritten/gs->renderFrames : 0.0, gs->renderFrames ? (double)gs->frame.cellsRect/gs->renderFrames : 0.0, gs->frame.nSprites, gs->frame.nSpans);
+  fprintf(fp,"idle: %ld frames not drawn, %ld waits\n", gs->perf.idleFrames, idleWaits);
+  fprintf(fp,"writer: %ld frames sent, %ld dropped, %ld kB; %ld stalls, %.3f ms all told, %.3f ms worst\n", gs->perf.framesSent, gs->perf.framesDropped, gs->perf.termBytes/1024, gs->perf.stalls, termStalled(gs)/1e6, termWorstStall(gs)/1e6);
+  fprintf(fp,"arena: %zu of %zu bytes carved, %zu high water, %ld games; %d sprite pads\n", gs->arena.used, gs->arena.size, gs->arena.high, gs->arena.resets, gs->nShapes);
+}
+
+size_t sessionBytes(gSession* s) {
+  // what a session holds outside curses
+  return sizeof(gSession) + s->arena.size + s->frame.w*s->frame.h*2*sizeof(chtype) + s->frame.cap*sizeof(blit) + (MAX_RENDER_THREADS*s->frame.cap + MAX_RENDER_THREADS)*sizeof(int);
+}
+
+void sessionsDump(FILE* fp, double secs) {
+  double cpu, cpuWorst = 0.0, cpuSum = 0.0;
+  long missed = 0;
+  int i;
+
+  fprintf(fp,"\n");
+  for (i = 0; i < nSessions; i++) {
+    gs = &sessions[i];
+    cpu = gs->cpuNs/1e6/secs;
+    cpuSum += cpu;
+    if (cpu > cpuWorst) {
+      cpuWorst = cpu;
+    }
+    if (gs->perf.missed > missed) {
+      missed = gs->perf.missed; // the frame loop is shared, so this is the loop's count
+    }
+    fprintf(fp,"session %d: %.3f ms cpu/s, %ld frames, %.3f ms worst frame, %ld missed, %ld games, %ld frames dropped, %.3f ms worst stall\n", i, cpu, gs->perf.frames, gs->perf.worstFrame/1e6, gs->perf.missed, gs->arena.resets, gs->perf.framesDropped, termWorstStall(gs)/1e6);
+  }
+  fprintf(fp,"sessions: %d over %.1f s, %.3f ms cpu/s mean, %.3f worst, %ld deadlines missed\n", nSessions, secs, cpuSum/nSessions, cpuWorst, missed);
+  fprintf(fp,"  %zu bytes of game state each\n", sessionBytes(&sessions[0]));
+}
+
+struct timespec started;
+
+/* live metrics */
+
+void metricsOpen() {
+  // a segment for astervoid-top; the game runs the same without one
+  size_t size = sizeof(avMetrics) + nSessions*sizeof(avSession);
+  int fd, i;
+
+  statmFd = open("/proc/self/statm", O_RDONLY);
+  snprintf(metricsName, sizeof(metricsName), AV_METRICS_PREFIX "%d", (int)getpid());
+  if ((fd = shm_open(metricsName, O_CREAT | O_TRUNC | O_RDWR, 0644)) < 0) {
+    return;
+  }
+  if (ftruncate(fd, size) < 0 || (metrics = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    metrics = NULL;
+    close(fd);
+    shm_unlink(metricsName);
+    return;
+  }
+  close(fd);
+  metrics->size = size;
+  metrics->pid = getpid();
+  metrics->nSessions = nSessions;
+  metrics->fps = FPS;
+  metrics->renderFps = RENDER_FPS;
+  metrics->started = time(NULL);
+  for (i = 0; i < nSessions; i++) {
+    metrics->sessions[i].id = i;
+  }
+  // readers skip a segment until it says what it is
+  metrics->version = AV_METRICS_VERSION;
+  atomic_thread_fence(memory_order_release);
+  metrics->magic = AV_METRICS_MAGIC;
+}
+
+void metricsClose() {
+  if (metrics) {
+    shm_unlink(metricsName);
+  }
+}
 
-  displayOnBattleField(wStatus,2,1,70,1);
+void metricsProcess() {
+  long pages = procField(statmFd, " "); // statm: total pages, then resident
+
+  if (metrics == NULL) {
+    return;
+  }
+  avWriteBegin(&metrics->seq);
+  metrics->rssKb = pages * (sysconf(_SC_PAGESIZE) / 1024);
+  avWriteEnd(&metrics->seq);
 }
 
-void statusClear(){
-  clearFromBattleField(2,0,70,0);
+void metricsPublish(gSession* s) {
+  // only the thread running s writes its record
+  avSession* m;
+
+  if (metrics == NULL) {
+    return;
+  }
+  m = &metrics->sessions[s->id];
+  avWriteBegin(&m->seq);
+  m->live = s->live;
+  m->status = s->stats.status;
+  m->level = s->stats.level;
+  m->score = s->ship.score;
+  m->ticks = s->perf.ticks;
+  m->frames = s->perf.frames;
+  m->missed = s->perf.missed;
+  m->cpuNs = s->cpuNs;
+  m->tickNs = s->perf.tickNs;
+  m->sceneNs = s->perf.sceneNs;
+  m->composeNs = s->perf.composeNs;
+  m->flushNs = s->perf.flushNs;
+  m->lAst = s->lAst;
+  m->lMiss = s->lMiss;
+  m->lChest = s->lChest;
+  m->nUfo = s->nUfo;
+  m->hits = s->perf.hits;
+  m->hitsApplied = s->perf.hitsApplied;
+  m->pads = s->nShapes;
+  m->termBytes = s->perf.termBytes;
+  m->dropped = s->perf.framesDropped;
+  m->stallNs = termStalled(s);
+  avWriteEnd(&m->seq);
 }
 
 static void finish(int sig) {
-  endwin();
+  struct timespec now;
+  FILE* fp = instrument ? stderr : NULL;
+  int i;
 
-  fprintf(stderr,"Thank you for playing Astervoid, come back soon\n");
-  fprintf(stderr,"\n");
-  fprintf(stderr,"=========================================================================\n");
-  fprintf(stderr,"\n");
-  fprintf(stderr,"Final score: %7.7ld\nFinal rank: %s \n",ship.score,stats.rank);
+  metricsClose();
+  if (!serving) {
+    cursesEnter();
+    atomic_store(&sessions[0].framePending, 0);
+    sessions[0].live = 0;
+    endwin();
+    cursesLeave();
+  }
+  for (i = 0; i < nSessions; i++) {
+    termDrain(&sessions[i]);
+  }
+  gs = &sessions[0];
+  if (!serving) {
+
+    fprintf(stderr,"Thank you for playing Astervoid, come back soon\n");
+    fprintf(stderr,"\n");
+    fprintf(stderr,"=========================================================================\n");
+    fprintf(stderr,"\n");
+    fprintf(stderr,"Final score: %7.7ld\nFinal rank: %s \n",gs->ship.score,gs->stats.rank);
+  }
+  if (instrPath) {
+    fp = fopen(instrPath, "w");
+  }
+  if (fp) {
+    if (serving) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      sessionsDump(fp, tsNs(&now, &started)/1e9);
+    } else {
+      instrDump(fp);
+    }
+    if (fp != stderr) {
+      fclose(fp);
+    }
+  }
   exit(sig);
 }
 
+void sessionEnd() {
+  // the player is done; the others play on
+  WINDOW* wins[] = {gs->wEmpty, gs->wBattleField, gs->wStarField, gs->wStatus, gs->wGameOver, gs->wGamePaused, gs->wTitleScreen, gs->wTitleText, gs->wStartText, gs->wRestartText};
+  int i;
+
+  cursesEnter();
+  // no frame goes out after endwin; the writer still sends what endwin
+  // wrote before it lets the terminal go
+  atomic_store(&gs->framePending, 0);
+  gs->live = 0;
+  endwin();
+  // delscreen would take every session's windows with it, so only ours go
+  for (i = 0; i < (int)(sizeof(wins)/sizeof(WINDOW*)); i++) {
+    delwin(wins[i]);
+  }
+  for (i = 0; i < gs->nShapes; i++) {
+    delwin(gs->shapes[i].pad);
+  }
+  gs->nShapes = 0;
+  cursesLeave();
+  writerWake();
+  free(gs->arena.base);
+  frameFree(&gs->frame);
+  free(gs->rasterId);
+  free(gs->rasterMore);
+  free(gs->rasterNodes);
+  free(gs->tree.nodes);
+}
+
+void gameQuit() {
+  if (serving) {
+    sessionEnd();
+  } else {
+    finish(0);
+  }
+}
+
 /* initializations */
 
 void gameLevel() {
-  if (ship.score > 0 && ship.score > stats.level*100) {
+  if (gs->ship.score > 0 && gs->ship.score > gs->stats.level*100) {
     // level up
-    if (stats.astSpeed > 1) {
-      stats.astSpeed-=1;
+    if (gs->stats.astSpeed > 1) {
+      gs->stats.astSpeed-=1;
     }
-    if (stats.ufoSpeed > 1) {
-      stats.ufoSpeed-=1;
+    if (gs->stats.ufoSpeed > 1) {
+      gs->stats.ufoSpeed-=1;
     }
-    ship.score+=1;
-    stats.level+=1;
-    stats.astLevel+=1;
-    strcpy(stats.rank,ranks[mod(stats.level, 6)]);
-    if (lChest<MAX_CHESTS) {
-      chestInit(lChest);
-      lChest++;
+    gs->ship.score+=1;
+    gs->stats.level+=1;
+    gs->stats.astLevel+=1;
+    strcpy(gs->stats.rank,ranks[mod(gs->stats.level, 6)]);
+    if (gs->lChest<MAX_CHESTS) {
+      chestInit(gs->lChest);
+      gs->lChest++;
     }
+    ufoFleetGrow();
+    shipScore(0); // a big haul can be worth another level
   }
 }
 
 void resetStats() {
-  stats.astSpeed = 6;
-  stats.ufoSpeed = 7;
-  stats.level=1;
-  stats.astLevel=6;
-  strcpy(stats.rank,ranks[0]);
+  gs->stats.astSpeed = 6;
+  gs->stats.ufoSpeed = 7;
+  gs->stats.level=1;
+  gs->stats.astLevel=6;
+  strcpy(gs->stats.rank,ranks[0]);
+}
+
+void gameCarve() {
+  // everything a game owns comes out of the arena, so dropping
+  // the last game is one reset however much it got up to
+  int i;
+
+  arenaReset(&gs->arena);
+  gs->asts = arenaAlloc(&gs->arena, MAX_ASTEROIDS*sizeof(spOb));
+  gs->chests = arenaAlloc(&gs->arena, MAX_CHESTS*sizeof(spOb));
+  gs->missles = arenaAlloc(&gs->arena, MAX_MISSLES*sizeof(spOb));
+  gs->effects = arenaAlloc(&gs->arena, MAX_EFFECTS*sizeof(fxOb));
+  gs->hits = arenaAlloc(&gs->arena, MAX_HITS*sizeof(hitEvent));
+  gs->ufos = arenaAlloc(&gs->arena, MAX_UFOS*sizeof(spOb));
+  gs->ufoEvents = arenaAlloc(&gs->arena, MAX_UFOS*sizeof(tmEvent));
+  gs->gridStart = arenaAlloc(&gs->arena, (GRID_COLS*GRID_ROWS+1)*sizeof(int));
+  gs->gridItems = arenaAlloc(&gs->arena, MAX_ASTEROIDS*sizeof(short));
+  gs->astStamp = arenaAlloc(&gs->arena, MAX_ASTEROIDS*sizeof(unsigned int));
+  gs->rasterCand = arenaAlloc(&gs->arena, MAX_ASTEROIDS*sizeof(short));
+  gs->astTouch = arenaAlloc(&gs->arena, MAX_ASTEROIDS*sizeof(unsigned long long));
+  gs->slotBox = arenaAlloc(&gs->arena, MAX_ASTEROIDS*sizeof(rasterBox));
+  gs->slotAst = arenaAlloc(&gs->arena, MAX_ASTEROIDS*sizeof(short));
+  gs->slotLive = arenaAlloc(&gs->arena, MAX_ASTEROIDS);
+  gs->slotFree = arenaAlloc(&gs->arena, MAX_ASTEROIDS*sizeof(short));
+  gs->astMoved = arenaAlloc(&gs->arena, MAX_ASTEROIDS);
+  gs->pairs = arenaAlloc(&gs->arena, MAX_HITS*sizeof(astPair));
+  gs->pairsNow = arenaAlloc(&gs->arena, MAX_HITS*sizeof(astPair));
+  gs->rasterW = 0; // the raster starts over with the new asteroids
+  gs->bodies = arenaAlloc(&gs->arena, MAX_ASTEROIDS*sizeof(bhBody));
+  gs->bodyAst = arenaAlloc(&gs->arena, MAX_ASTEROIDS*sizeof(short));
+  gs->moves = arenaAlloc(&gs->arena, sizeof(tmWheel));
+  gs->astMoves = arenaAlloc(&gs->arena, MAX_ASTEROIDS*sizeof(tmEvent));
+  gs->moveAst = arenaAlloc(&gs->arena, MAX_ASTEROIDS*sizeof(short));
+  gs->moveFree = arenaAlloc(&gs->arena, MAX_ASTEROIDS*sizeof(short));
+  gs->moveSettle = arenaAlloc(&gs->arena, MAX_ASTEROIDS*sizeof(short));
+  tmInit(gs->moves);
+  for (i = 0; i < MAX_ASTEROIDS; i++) {
+    gs->moveAst[i] = -1;
+    gs->moveFree[i] = MAX_ASTEROIDS-1-i;
+  }
+  gs->nMoveFree = MAX_ASTEROIDS;
+  gs->nMoveSettle = 0;
+  gs->nHits = 0;
+  for (i = 0; i < MAX_EFFECTS; i++) {
+    gs->effects[i].kind = -1;
+  }
 }
 
-void initAll() {
+void screenInit() {
+  // windows and pads live as long as the terminal does
   statusInit();
   gameOverInit();
   gamePausedInit();
   titleScreenInit();
   starFieldInit();
   battleFieldInit();
+  frameInit(&gs->frame, gs->max_x, gs->max_y, MAX_BLITS);
+  arenaInit(&gs->arena, ARENA_SIZE);
+}
+
+void initAll() {
+  // pending events may point into the old arena
+  int k;
+
+  effectsClear();
+  for (k = 0; k < gs->nUfo; k++) {
+    tmCancel(&gs->wheel, &gs->ufoEvents[k]);
+  }
+  tmCancel(&gs->wheel, &gs->levelEvent);
+
+  gameCarve();
+  starFieldSeed();
+  frameBackground(&gs->frame, gs->wEmpty);
   shipInit();
   asteroidInit(0);
-  lAst=1;
-  lMiss=0;
-  ufoInit();
-  ufo.score = 0;
+  gs->lAst=1;
+  gs->lMiss=0;
+  gs->lChest=0;
   resetStats();
+  gs->nUfo = 0;
+  ufoFleetGrow();
+  gs->ufoScore = 0;
+
+  tmSchedule(&gs->wheel, &gs->chestEvent, EV_CHEST, 0, geometricTicks(CHEST_CHANCE));
 }
 
 void gamePlay() {
-  initscr();
+  struct winsize ws;
+
+  termOpen();
+  pthread_mutex_lock(&cursesLock);
+  gs->screen = newterm(NULL, gs->out, gs->in);
+  if (gs->screen == NULL) {
+    fprintf(stderr, "astervoid: cannot start curses on session %d\n", gs->id);
+    exit(1);
+  }
+  // curses only has a file to ask, so it gets the terminal's size from us
+  if (ioctl(gs->tty, TIOCGWINSZ, &ws) == 0 && ws.ws_row >= 3 && ws.ws_col >= 3) {
+    resizeterm(ws.ws_row, ws.ws_col);
+  }
+  gs->live = 1;
+  gs->shown = -1;
   clear();
   keypad(stdscr, TRUE);
   nonl();	
@@ -886,163 +3358,416 @@ void gamePlay() {
   init_pair(MAGENTA, COLOR_MAGENTA, COLOR_BLACK);
   init_pair(WHITE, COLOR_WHITE, COLOR_BLACK);
 
-  getmaxyx(stdscr, scrmax_y, scrmax_x);
-  max_x = scrmax_x;// + 100;
-  max_y = scrmax_y;// + 100;
+  getmaxyx(stdscr, gs->scrmax_y, gs->scrmax_x);
+  gs->max_x = gs->scrmax_x;// + 100;
+  gs->max_y = gs->scrmax_y;// + 100;
 
+  tmInit(&gs->wheel);
+  screenInit();
+  pthread_mutex_unlock(&cursesLock);
   initAll();
 }
 
 void gameReset() {
-  battleFieldClear();
   //initAll();
-  ship.x=max_x/2;
-  ship.y=max_y/2;
-  ship.max_x=ship.x+1;
-  ship.max_y=ship.y;
-  ship.drift=0;
-  spObRefresh(&ship);
-  spObOnBattleField(&ship);
+  gs->ship.x=gs->max_x/2;
+  gs->ship.y=gs->max_y/2;
+  gs->ship.px=gs->ship.x;
+  gs->ship.py=gs->ship.y;
+  gs->ship.lx = gs->ship.x;
+  gs->ship.ly = gs->ship.y;
+  gs->ship.max_x=gs->ship.x+1;
+  gs->ship.max_y=gs->ship.y;
+  gs->ship.drift=0;
 }
 
 void gameReplay() {
   initAll();
-  spObOnBattleField(&ship);
 }
 
-void readInput() {
-
-  int ch;
-  int m=0;
-  ch = getch();
+void inputApply(int cmd) {
 
-  switch (stats.status) {
+  switch (gs->stats.status) {
 
   case GAME_PAUSED:
 
-    if (ch == 'p') {
-      gamePausedClear();
-      stats.status = GAME_PLAY;
+    if (cmd == CMD_PAUSE) {
+      gs->stats.status = GAME_PLAY;
     }
     break;
 
   case GAME_OVER:
-    if (ch == ' ') {
-      gameOverClear();
-      stats.status = GAME_PLAY;
-      //battleFieldClear();
+    if (cmd == CMD_FIRE) {
+      gs->stats.status = GAME_PLAY;
       gameReplay();
     }
-    if (ch == 't') {
-      gameOverClear();
-      stats.status = GAME_TITLE;
+    if (cmd == CMD_TITLE) {
+      gs->stats.status = GAME_TITLE;
       gameReplay();
     }
-    if (ch == 'q') {
-      finish(0);
+    if (cmd == CMD_QUIT) {
+      gameQuit();
     }
     break;
 
   case GAME_TITLE:
-    if (ch == ' ') {
-      titleScreenClear();
-      stats.status = GAME_PLAY;
+    if (cmd == CMD_FIRE) {
+      gs->stats.status = GAME_PLAY;
       gameReplay();
-      battleFieldClear();
     }
-    if (ch == 'q') {
-      finish(0);
+    if (cmd == CMD_QUIT) {
+      gameQuit();
     }
     break;
     
   case GAME_PLAY:
-    if (ch == 'q') {
-      battleFieldClear();
-      stats.status = GAME_TITLE;
-    } else if (ch == 'p') { 
-      stats.status = GAME_PAUSED;
-    } else if (ch == 'd' || ch == KEY_RIGHT) {
-      if (ship.dS == 7) {
-	ship.dS = 0;
+    if (cmd == CMD_QUIT) {
+      gs->stats.status = GAME_TITLE;
+    } else if (cmd == CMD_PAUSE) {
+      gs->stats.status = GAME_PAUSED;
+    } else if (cmd == CMD_RIGHT) {
+      if (gs->ship.dS == 7) {
+	gs->ship.dS = 0;
       } else {
-	ship.dS+=1;
+	gs->ship.dS+=1;
       }
-      ship.dOb = dShips[ship.dS];
-    } else if (ch == 'a' || ch == KEY_LEFT) {
-      if (ship.dS == 0) {
-	ship.dS = 7;
+      gs->ship.dOb = dShips[gs->ship.dS];
+    } else if (cmd == CMD_LEFT) {
+      if (gs->ship.dS == 0) {
+	gs->ship.dS = 7;
       } else {
-	ship.dS-=1;
-      }
-      ship.dOb = dShips[ship.dS];
-    } else if (ch == 'w' || ch == KEY_UP) {
-      ship.dx = dxShips[ship.dS];
-      ship.dy = dyShips[ship.dS];
-      spObRefresh(&ship);
-      spObMove(&ship);
-      ship.drift = 1;
-    } else if (ch == 's' || ch == KEY_DOWN) {
-      ship.drift = 0;
-    } else if (ch == ' ') {
-      if (lMiss < MAX_MISSLES) {
-	missleInit(lMiss);
-	lMiss+=1;
-      }
-    } else if (ch == 'c') {
-      chestInit(lChest);
-      lChest+=1;
-    } else if (lAst < MAX_ASTEROIDS) {
-      asteroidInit(lAst);
-      lAst+=1;
+	gs->ship.dS-=1;
+      }
+      gs->ship.dOb = dShips[gs->ship.dS];
+    } else if (cmd == CMD_THRUST) {
+      gs->ship.dx = dxShips[gs->ship.dS];
+      gs->ship.dy = dyShips[gs->ship.dS];
+      spObMove(&gs->ship);
+      gs->ship.drift = 1;
+    } else if (cmd == CMD_BRAKE) {
+      gs->ship.drift = 0;
+    } else if (cmd == CMD_FIRE) {
+      if (gs->lMiss < missleCap()) {
+	missleInit(gs->lMiss);
+	gs->lMiss+=1;
+      }
+    } else if (cmd == CMD_CHEST) {
+      if (gs->lChest < MAX_CHESTS) {
+	chestInit(gs->lChest);
+	gs->lChest+=1;
+      }
+    } else if (cmd == CMD_SPAWN && gs->lAst < MAX_ASTEROIDS) {
+      asteroidInit(gs->lAst);
+      gs->lAst+=1;
     }   
-    wrefresh(wBattleField);
   }
 }
 
-/* game handler */
+/* input thread */
+
+int keyCommand(int ch) {
+  switch (ch) {
+  case 'a': case KEY_LEFT: return CMD_LEFT;
+  case 'd': case KEY_RIGHT: return CMD_RIGHT;
+  case 'w': case KEY_UP: return CMD_THRUST;
+  case 's': case KEY_DOWN: return CMD_BRAKE;
+  case ' ': return CMD_FIRE;
+  case 'p': return CMD_PAUSE;
+  case 'q': return CMD_QUIT;
+  case 't': return CMD_TITLE;
+  case 'c': return CMD_CHEST;
+  }
+  return CMD_SPAWN;
+}
+
+int inputPush(inRing* r, int cmd) {
+  unsigned int h = atomic_load_explicit(&r->head, memory_order_relaxed);
+  unsigned int t = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+  if (h - t == INPUT_RING) {
+    return 0; // full, the key is dropped
+  }
+  r->cmds[h & (INPUT_RING-1)].cmd = cmd;
+  clock_gettime(CLOCK_MONOTONIC, &r->cmds[h & (INPUT_RING-1)].ts);
+  atomic_store_explicit(&r->head, h+1, memory_order_release);
+  return 1;
+}
+
+inCmd* inputPeek(inRing* r) {
+  unsigned int t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  unsigned int h = atomic_load_explicit(&r->head, memory_order_acquire);
+
+  if (t == h) {
+    return NULL;
+  }
+  return &r->cmds[t & (INPUT_RING-1)];
+}
+
+void inputPop(inRing* r) {
+  unsigned int t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  atomic_store_explicit(&r->tail, t+1, memory_order_release);
+}
+
+int tsBefore(struct timespec* a, struct timespec* b) {
+  return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec <= b->tv_nsec);
+}
+
+void readInput(struct timespec* now) {
+  inCmd* c;
+  int cmd;
+
+  // only commands read before this tick started belong to it
+  while (gs->live && (c = inputPeek(&gs->input)) != NULL && tsBefore(&c->ts, now)) {
+    cmd = c->cmd;
+    inputPop(&gs->input);
+    inputApply(cmd);
+  }
+}
 
-void handleTimer() {
+void inputDecode(inRing* r, unsigned char* buf, int n, int* esc) {
+  // *esc carries a sequence across reads: 1 after ESC, 2 after ESC [ or
+  // ESC O, 3 once it has parameters; only a bare arrow makes a key
   int i;
-  
-  switch (stats.status) {
-    
-  case GAME_PAUSED:
-    if (stats.status == GAME_PAUSED) {
-      gamePausedDisplay();
+
+  for (i = 0; i < n; i++) {
+    if (*esc == 1 && (buf[i] == '[' || buf[i] == 'O')) {
+      *esc = 2;
+      continue;
     }
-    break;
+    if (*esc >= 2 && buf[i] >= 0x20 && buf[i] <= 0x3f) {
+      *esc = 3; // parameters and intermediates, up to the final byte
+      continue;
+    }
+    if (*esc >= 2 && buf[i] >= '@' && buf[i] <= '~') {
+      if (*esc == 2) {
+	switch (buf[i]) {
+	case 'A': inputPush(r, keyCommand(KEY_UP)); break;
+	case 'B': inputPush(r, keyCommand(KEY_DOWN)); break;
+	case 'C': inputPush(r, keyCommand(KEY_RIGHT)); break;
+	case 'D': inputPush(r, keyCommand(KEY_LEFT)); break;
+	}
+      }
+      *esc = 0; // anything else is dropped, not taken as keys
+      continue;
+    }
+    // a broken off sequence goes, the byte is read as it is
+    *esc = 0;
+    if (buf[i] == 27) {
+      *esc = 1;
+    } else {
+      inputPush(r, keyCommand(buf[i]));
+    }
+  }
+}
 
-  case GAME_TITLE:
-    if (stats.status == GAME_TITLE) {
-      titleScreenDisplay();
+void* inputLoop(void* arg) {
+  struct pollfd pfd[nSessions];
+  int esc[nSessions];
+  unsigned char buf[32];
+  int n, i;
+
+  for (i = 0; i < nSessions; i++) {
+    pfd[i].fd = sessions[i].fd;
+    pfd[i].events = POLLIN;
+    esc[i] = 0;
+  }
+  // curses is not thread safe, so the raw bytes are decoded here rather than by getch()
+  while (1) {
+    if (poll(pfd, nSessions, -1) < 0) {
+      continue;
+    }
+    for (i = 0; i < nSessions; i++) {
+      if (pfd[i].revents == 0) {
+	continue;
+      }
+      n = read(pfd[i].fd, buf, sizeof(buf));
+      if (n <= 0) {
+	// gone for good; poll skips negative fds
+	pfd[i].fd = -1;
+	atomic_store(&sessions[i].hangup, 1);
+	continue;
+      }
+      inputDecode(&sessions[i].input, buf, n, &esc[i]);
+    }
+    wakeUp();
+  }
+  return NULL;
+}
+
+/* game handler */
+
+int shipHit(int* down) {
+  if (*down) {
+    return 0; // one life a tick, however many things hit it
+  }
+  *down = 1;
+  explosionDisplay(gs->ship.x,gs->ship.y,2,1);
+  gs->ship.lives-=1;
+  gs->stats.status = GAME_RESET;
+  return 1;
+}
+
+int ufoHit(int k) {
+  if (!gs->ufos[k].draw) {
+    return 0;
+  }
+  explosionDisplay(gs->ufos[k].x,gs->ufos[k].y,5,1);
+  ufoKill(k);
+  return 1;
+}
+
+void collisionResolve() {
+  // in the order they were seen; an ob is spent by its first hit, so
+  // later events naming it are duplicates and change nothing
+  hitEvent* e;
+  spOb *m, *a;
+  int i, applied, shipDown = 0;
+
+  for (i = 0; i < gs->nHits; i++) {
+    e = &gs->hits[i];
+    m = &gs->missles[e->a];
+    a = &gs->asts[e->b];
+    applied = 0;
+    switch (e->kind) {
+    case HIT_SHIP_UFO:
+      applied = shipHit(&shipDown);
+      break;
+    case HIT_SHIP_CHEST:
+      if (gs->chests[e->b].draw) {
+	bonusDisplay(gs->ship.x,gs->ship.y,2,1,gs->ship.dOb);
+	shipScore(10);
+	gs->ship.lives+=1;
+	gs->chests[e->b].draw=0;
+	applied = 1;
+      }
+      break;
+    case HIT_UFO_CHEST:
+      if (gs->chests[e->b].draw && gs->ufos[e->a].draw) {
+	bonusDisplay(gs->ufos[e->a].x,gs->ufos[e->a].y,5,1,gs->ufos[e->a].dOb);
+	gs->ufoScore+=10;
+	gs->chests[e->b].draw=0;
+	applied = 1;
+      }
+      break;
+    case HIT_SHIP_MISSLE:
+      if (m->draw) {
+	m->draw = 0;
+	shipHit(&shipDown);
+	applied = 1;
+      }
+      break;
+    case HIT_UFO_MISSLE:
+      if (m->draw && gs->ufos[e->b].draw) {
+	m->draw = 0;
+	ufoHit(e->b);
+	shipScore(2);
+	applied = 1;
+      }
+      break;
+    case HIT_AST_MISSLE:
+      if (m->draw && a->draw) {
+	breakDisplay(e->b);
+	a->draw = 0;
+	if (m->subtype == 1) {
+	  gs->ufoScore+=1;
+	} else {
+	  shipScore(1);
+	}
+	m->draw = 0;
+	applied = 1;
+      }
+      break;
+    case HIT_SHIP_AST:
+      if (a->draw) {
+	a->draw = 0;
+	shipHit(&shipDown);
+	applied = 1;
+      }
+      break;
+    case HIT_UFO_AST:
+      applied = ufoHit(e->a);
+      break;
+    case HIT_AST_AST:
+      // a pile up takes out everything in it
+      applied = gs->asts[e->a].draw || a->draw;
+      gs->asts[e->a].draw = 0;
+      a->draw = 0;
+      break;
+    }
+    if (applied) {
+      gs->perf.hitsApplied++;
+    }
+  }
+  gs->perf.hits += gs->nHits;
+  gs->nHits = 0;
+
+  // indexes shift as asteroids go, so they only break up once every event is done
+  for (i = 0; i < gs->lAst; ) {
+    if (gs->asts[i].draw) {
+      i++;
+    } else if (gs->asts[i].subtype == 2) {
+      asteroidRemove(i);
+    } else {
+      asteroidSplit(i);
+    }
+  }
+}
+
+void collisionMonitor() {
+  collisionDetect();
+  collisionResolve();
+}
+
+void gameEvent(tmEvent* ev) {
+  switch (ev->kind) {
+  case EV_CHEST:
+    if (gs->lChest<MAX_CHESTS) {
+      chestInit(gs->lChest);
+      gs->lChest++;
     }
+    tmSchedule(&gs->wheel, &gs->chestEvent, EV_CHEST, 0, geometricTicks(CHEST_CHANCE));
+    break;
+  case EV_UFO:
+    ufoInit(ev->arg);
+    break;
+  case EV_LEVEL:
+    gameLevel();
     break;
+  case EV_EFFECT:
+    effectStop(ev->arg);
+    break;
+  }
+}
+
+void handleTimer(struct timespec* now) {
+  int i;
+
+  readInput(now);
+  if (!gs->live) {
+    return; // quit from this tick's keys
+  }
+
+  switch (gs->stats.status) {
 
   case GAME_RESET:
     gameReset();
-    stats.status=GAME_PLAY;
+    gs->stats.status=GAME_PLAY;
     
   case GAME_PLAY:
 
     collisionMonitor();
-    gameLevel();
+    tmAdvance(&gs->wheel, gameEvent);
 
-    if (ship.lives == 0) {
-      stats.status = GAME_OVER;
+    if (gs->ship.lives == 0) {
+      gs->stats.status = GAME_OVER;
     }
 
     // chests
-    if (lChest<MAX_CHESTS && (random() % 1000) == 0) {
-      chestInit(lChest);
-      lChest++;
-    }
-
-    if (lChest > 0) {
-      for (i = 0; i< lChest; i++) {
-	if (chests[i].draw) {
-	  chests[i].color=mod(chests[i].mvcnt, 6);
-	  spObRefresh(&chests[i]);
-	  spObMove(&chests[i]);
+    if (gs->lChest > 0) {
+      for (i = 0; i< gs->lChest; i++) {
+	if (gs->chests[i].draw) {
+	  gs->chests[i].color=mod(gs->chests[i].mvcnt, 6);
+	  spObMove(&gs->chests[i]);
 	} else {
 	  chestRemove(i);
 	}
@@ -1050,89 +3775,666 @@ void handleTimer() {
     }
     
     // asteroids
-    if (lAst < stats.astLevel && lAst < MAX_ASTEROIDS) {
-      asteroidInit(lAst);
-      lAst++;
+    if (gs->lAst < gs->stats.astLevel && gs->lAst < MAX_ASTEROIDS) {
+      asteroidInit(gs->lAst);
+      gs->lAst++;
     }
-    for (i = 0; i < lAst; i++) {
-      if (asts[i].draw) {
-	spObMove(&asts[i]);
-      } else {
-	if (asts[i].subtype == 2) {
-	  asteroidRemove(i);
-	} else {
-	  asteroidSplit(i);
-	}
-      }
+    if (gravity) {
+      gravityStep();
     }
+    asteroidsMove();
     
     // missles
-    for (i = 0; i < lMiss; i++) {
-      if (missles[i].draw) {
-	spObRefresh(&missles[i]);
-	spObMove(&missles[i]);
+    for (i = 0; i < gs->lMiss; i++) {
+      if (gs->missles[i].draw) {
+	spObMove(&gs->missles[i]);
       } else {
 	missleRemove(i);
       }
     }
     
     // ship
-    if (ship.drift == 1) {
-      spObMove(&ship);
-    }
-    spObRefresh(&ship);
-    spObOnBattleField(&ship);
-
-    // ufo
-    if (ufo.draw) {
-      spObMove(&ufo);
-      if (lMiss < MAX_MISSLES && (random() % ufo.speed) == 0) {
-	ufoMissleInit(lMiss);
-	lMiss+=1;
-      }
-      //if ((random() % ufo.speed) == 0) {
-      ufo.dOb = dUfo[ufo.dS];
-      //}
+    if (gs->ship.drift == 1) {
+      spObMove(&gs->ship);
     } else {
-      spObFromBattleField(&ufo);
-      ufoInit();
+      gs->ship.px = gs->ship.x;
+      gs->ship.py = gs->ship.y;
+      gs->ship.lx = gs->ship.x;
+      gs->ship.ly = gs->ship.y;
+    }
+
+    // ufos
+    ufoFleet();
+    break;
+  }
+}
+
+/* rendering */
+
+void renderScene(double alpha) {
+  int i;
+
+  // every frame is composed from the empty starfield up
+  frameBegin(&gs->frame);
+
+  if (gs->stats.status == GAME_TITLE) {
+    titleScreenDisplay();
+  } else {
+    for (i = 0; i < gs->lChest; i++) {
+      if (gs->chests[i].draw) {
+	spObOnBattleField(&gs->chests[i], alpha);
+      }
+    }
+    for (i = 0; i < gs->lAst; i++) {
+      if (gs->asts[i].draw) {
+	spObOnBattleField(&gs->asts[i], alpha);
+      }
+    }
+    for (i = 0; i < gs->lMiss; i++) {
+      if (gs->missles[i].draw) {
+	spObOnBattleField(&gs->missles[i], alpha);
+      }
+    }
+    spObOnBattleField(&gs->ship, alpha);
+    for (i = 0; i < gs->nUfo; i++) {
+      if (gs->ufos[i].draw) {
+	spObOnBattleField(&gs->ufos[i], alpha);
+      }
+    }
+    for (i = 0; i < MAX_EFFECTS; i++) {
+      if (gs->effects[i].kind >= 0) {
+	effectDraw(&gs->effects[i]);
+      }
     }
-    // status
     statusDisplay();
 
-  case GAME_OVER:
-    if (stats.status == GAME_OVER) {
+    if (gs->stats.status == GAME_PAUSED) {
+      gamePausedDisplay();
+    } else if (gs->stats.status == GAME_OVER) {
       gameOverDisplay();
     }
-    break;
   }
 }
 
-void setUpTimer() {
+int renderBands() {
+  // hosted sessions already keep the workers busy, one each
+  return !serving && gs->frame.w*gs->frame.h >= BAND_MIN_CELLS ? renderThreads : 1;
+}
 
-  struct itimerval myTimer;
-  struct sigaction myAction;
-  myTimer.it_value.tv_sec = 0;
-  myTimer.it_value.tv_usec = 1000000 / FPS;
-  myTimer.it_interval.tv_sec = 0;
-  myTimer.it_interval.tv_usec = 1000000 / FPS;
-  setitimer(ITIMER_REAL, &myTimer, NULL);
-  
-  myAction.sa_handler = &handleTimer;
-  myAction.sa_flags = SA_RESTART;
-  sigaction(SIGALRM, &myAction, NULL);
+void renderFrame(double alpha) {
+  struct timespec t0, t1, t2, t3;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  renderScene(alpha);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  if (renderCurses) {
+    t2 = t1; // copywin composes and flushes in one go
+    frameFlushCurses(&gs->frame, gs->wBattleField, gs->wEmpty);
+  } else {
+    frameCompose(&gs->frame, renderBands());
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    frameFlush(&gs->frame, gs->wBattleField);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t3);
+  gs->perf.sceneNs = tsNs(&t1, &t0);
+  gs->perf.composeNs = tsNs(&t2, &t1);
+  gs->perf.flushNs = tsNs(&t3, &t2);
+  gs->renderFrames++;
+}
+
+void sessionFrame(struct timespec* next, int sub) {
+  // one frame of the current session: a tick if one is due, then the draw
+  struct timespec t0, t1;
+  long ns;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if (atomic_load(&gs->hangup)) {
+    gameQuit();
+  }
+  if (!gs->live) {
+    return;
+  }
+  if (serving && sub == 0) {
+    gameResize(); // ttys we host send us no SIGWINCH
+  }
+  if (sub == 0) {
+    handleTimer(next);
+    if (!gs->live) {
+      return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns = tsNs(&t1, &t0);
+    gs->perf.tickNs = ns;
+    if (ns > gs->perf.worstTick) {
+      gs->perf.worstTick = ns;
+    }
+    gs->perf.ticks++;
+  }
+  if (gs->stats.status == GAME_PLAY) {
+    gs->alpha = (double)sub / (RENDER_FPS / FPS);
+  } else if (gs->shown == gs->stats.status) {
+    gs->perf.idleFrames++; // the title and the stopped screens only change on a key or a resize
+    return;
+  }
+  renderFrame(gs->alpha);
+  gs->shown = gs->stats.status;
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  ns = tsNs(&t1, &t0);
+  gs->perf.frames++;
+  gs->perf.frameNs += ns;
+  if (ns > gs->perf.worstFrame) {
+    gs->perf.worstFrame = ns;
+  }
+}
+
+/* session pool */
+
+pthread_t sessionWorkers[MAX_RENDER_THREADS];
+int sessionThreads = 0;
+pthread_barrier_t sessionStart;
+pthread_barrier_t sessionDone;
+atomic_int sessionNext;
+struct timespec* sessionDeadline;
+int sessionSub;
+
+void sessionRun(gSession* s) {
+  struct timespec c0, c1;
+
+  gs = s;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c0);
+  sessionFrame(sessionDeadline, sessionSub);
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c1);
+  s->cpuNs += tsNs(&c1, &c0);
+  metricsPublish(s);
+}
+
+void* sessionWorker(void* arg) {
+  int i;
+
+  while (1) {
+    pthread_barrier_wait(&sessionStart);
+    // sessions are handed out one at a time, so a slow one holds up a single worker
+    while ((i = atomic_fetch_add(&sessionNext, 1)) < nSessions) {
+      if (sessions[i].live) {
+	sessionRun(&sessions[i]);
+      }
+    }
+    pthread_barrier_wait(&sessionDone);
+  }
+  return NULL;
+}
+
+void sessionPoolStart(int threads) {
+  int i;
+
+  sessionThreads = threads < nSessions ? threads : nSessions;
+  pthread_barrier_init(&sessionStart, NULL, sessionThreads+1);
+  pthread_barrier_init(&sessionDone, NULL, sessionThreads+1);
+  for (i = 0; i < sessionThreads; i++) {
+    pthread_create(&sessionWorkers[i], NULL, sessionWorker, NULL);
+  }
+}
+
+int sessionsLive() {
+  int i, n = 0;
+
+  for (i = 0; i < nSessions; i++) {
+    n += sessions[i].live;
+  }
+  return n;
+}
+
+int sessionIdle(gSession* s) {
+  // nothing to run and nothing new to draw until a key or a resize
+  if (!s->live) {
+    return 1;
+  }
+  return !atomic_load(&s->hangup) && inputPeek(&s->input) == NULL && s->stats.status != GAME_PLAY && s->stats.status != GAME_RESET && s->shown == s->stats.status;
+}
+
+int idleWait() {
+  // block, rather than tick, while every session sits on a still screen
+  struct pollfd pfd;
+  char buf[64];
+  int i, idle, waited = 0;
+
+  pfd.fd = wakeFds[0];
+  pfd.events = POLLIN;
+  while (1) {
+    // emptied before looking, so a key that lands after the look still wakes the poll
+    while (read(wakeFds[0], buf, sizeof(buf)) > 0) {
+    }
+    idle = !resized && !repaint && !stopping;
+    for (i = 0; i < nSessions && idle; i++) {
+      idle = sessionIdle(&sessions[i]);
+    }
+    if (!idle) {
+      return waited;
+    }
+    idleWaits++;
+    waited = 1;
+    if (poll(&pfd, 1, serving ? IDLE_RESIZE_MS : -1) == 0) {
+      return waited; // a round of size checks, drawing nothing unless one changed
+    }
+  }
+}
+
+void timerLoop() {
+
+  struct timespec next, t1;
+  long n, ns;
+  int i;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  // the simulation ticks at FPS, the frame is drawn at RENDER_FPS
+  for (n = 0; ; n++) {
+    if (n % (RENDER_FPS / FPS) == 0 && idleWait()) {
+      clock_gettime(CLOCK_MONOTONIC, &next); // no deadlines were missed while blocked
+    }
+    next.tv_nsec += 1000000000 / RENDER_FPS;
+    if (next.tv_nsec >= 1000000000) {
+      next.tv_nsec -= 1000000000;
+      next.tv_sec += 1;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+    }
+
+    if (n % RENDER_FPS == 0) {
+      metricsProcess();
+    }
+    sessionDeadline = &next;
+    sessionSub = n % (RENDER_FPS / FPS);
+    if (serving) {
+      atomic_store(&sessionNext, 0);
+      pthread_barrier_wait(&sessionStart);
+      pthread_barrier_wait(&sessionDone);
+      if (sessionsLive() == 0) {
+	finish(0);
+      }
+    } else {
+      if (resized) {
+	resized = 0;
+	gameResize();
+      }
+      if (stopping) {
+	stopping = 0;
+	termStop();
+      }
+      if (repaint) {
+	repaint = 0;
+	cursesEnter();
+	clearok(curscr, TRUE);
+	cursesLeave();
+	gs->shown = -1;
+      }
+      sessionRun(&sessions[0]);
+    }
+
+    // past the next deadline already: count the misses and start over from
+    // now, rather than bursting frames to catch up
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns = tsNs(&t1, &next);
+    if (ns > 1000000000 / RENDER_FPS) {
+      for (i = 0; i < nSessions; i++) {
+	sessions[i].perf.missed += ns / (1000000000 / RENDER_FPS);
+      }
+      next = t1;
+    }
+  }
+}
+
+/* benchmarks */
+
+void benchScene(frameBuf* f, int n, int frameNo) {
+  int i, x, y;
+
+  frameBegin(f);
+  srandom(n); // the same field whatever the band count
+  for (i = 0; i < n; i++) {
+    x = mod(random() + frameNo*(i%3 - 1), f->w);
+    y = mod(random() + frameNo*(i%2 ? 1 : -1), f->h);
+    switch (random() % 4) {
+    case 0:
+      frameBlit(f, x, y, 10, 5, 10, dAst5[random() % 3][0], COLOR_PAIR(YELLOW), BLIT_SPRITE, NULL);
+      break;
+    case 1:
+      frameBlit(f, x, y, 4, 3, 4, dAst2[random() % 2][0], COLOR_PAIR(YELLOW), BLIT_SPRITE, NULL);
+      break;
+    case 2:
+      frameBlit(f, x, y, 1, 1, 1, "+", COLOR_PAIR(GREEN), BLIT_SPRITE, NULL);
+      break;
+    default:
+      frameBlit(f, x, y, 5, 1, 5, dUfo[random() % 3], COLOR_PAIR(RED), BLIT_SPRITE, NULL);
+    }
+  }
+}
+
+void benchRender() {
+  frameBuf ref, f;
+  int sprites[3] = {1000, 4000, 16000};
+  int i, s, bands, same;
+  struct timespec t0, t1;
+  double ms, ms1;
+
+  memset(&ref, 0, sizeof(ref));
+  memset(&f, 0, sizeof(f));
+  frameInit(&ref, BENCH_W, BENCH_H, sprites[2]);
+  frameInit(&f, BENCH_W, BENCH_H, sprites[2]);
+  for (i = 0; i < BENCH_W*BENCH_H; i++) {
+    ref.bg[i] = (random() % 60) == 0 ? ('*' | COLOR_PAIR(YELLOW)) : ' ';
+  }
+  memcpy(f.bg, ref.bg, BENCH_W*BENCH_H*sizeof(chtype));
+
+  printf("banded composition, %dx%d cells, %d frames\n", BENCH_W, BENCH_H, BENCH_FRAMES);
+  printf("%8s %6s %10s %8s %10s\n", "sprites", "bands", "ms/frame", "speedup", "identical");
+  for (s = 0; s < 3; s++) {
+    ms1 = 0.0;
+    for (bands = 1; bands <= renderThreads; bands*=2) {
+      if (bands*2 > renderThreads && bands < renderThreads) {
+	bands = renderThreads; // finish on the full pool
+      }
+      same = 1;
+      ms = 0.0;
+      for (i = 0; i < BENCH_FRAMES; i++) {
+	benchScene(&ref, sprites[s], i);
+	frameCompose(&ref, 1);
+	benchScene(&f, sprites[s], i);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	frameCompose(&f, bands);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ms += (t1.tv_sec - t0.tv_sec)*1e3 + (t1.tv_nsec - t0.tv_nsec)/1e6;
+	if (memcmp(ref.cells, f.cells, BENCH_W*BENCH_H*sizeof(chtype)) != 0) {
+	  same = 0;
+	}
+      }
+      ms /= BENCH_FRAMES;
+      if (bands == 1) {
+	ms1 = ms;
+      }
+      printf("%8d %6d %10.3f %8.2f %10s\n", sprites[s], bands, ms, ms1/ms, same ? "yes" : "NO");
+    }
+  }
+}
+
+void benchGravity() {
+  // the quadtree build and every body's pull, per step, against all
+  // pairs timed on a sample and scaled up
+  int sizes[4] = {1000, 4000, 16000, 32000};
+  bhTree t;
+  bhBody* b = calloc(sizes[3], sizeof(bhBody));
+  struct timespec t0, t1;
+  double ms, direct, err, norm, ax, ay, dx, dy, mag;
+  int s, i, j, k, n, step;
+
+  memset(&t, 0, sizeof(t));
+  printf("barnes-hut gravity, %dx%d torus, theta %.2f, %d steps\n", BENCH_W, BENCH_H, gravityTheta, BENCH_STEPS);
+  printf("%8s %10s %11s %13s %13s %8s\n", "bodies", "ms/step", "nodes/body", "ns/(n log n)", "all pairs ms", "error");
+  for (s = 0; s < 4; s++) {
+    n = sizes[s];
+    srandom(n);
+    for (i = 0; i < n; i++) {
+      b[i].x = random() % (BENCH_W*FIX_ONE) / (double)FIX_ONE;
+      b[i].y = random() % (BENCH_H*FIX_ONE) / (double)FIX_ONE;
+      b[i].m = random() % 2 ? GRAVITY_BIG : GRAVITY_SMALL;
+    }
+    t.opened = t.used = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (step = 0; step < BENCH_STEPS; step++) {
+      bhBuild(&t, b, n, BENCH_W, BENCH_H);
+      for (i = 0; i < n; i++) {
+	ax = ay = 0.0;
+	bhForce(&t, b[i].x, b[i].y, gravityTheta, &ax, &ay);
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ms = tsNs(&t1, &t0)/1e6/BENCH_STEPS;
+
+    // all pairs for a sample, and how far the tree's answer is from it
+    err = norm = 0.0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (k = 0; k < BENCH_SAMPLE; k++) {
+      i = k*(n/BENCH_SAMPLE);
+      dx = dy = 0.0;
+      for (j = 0; j < n; j++) {
+	bhPull(wrapNear(b[j].x - b[i].x, BENCH_W), wrapNear(b[j].y - b[i].y, BENCH_H), b[j].m, t.range, &dx, &dy);
+      }
+      ax = ay = 0.0;
+      bhForce(&t, b[i].x, b[i].y, gravityTheta, &ax, &ay);
+      mag = sqrt(dx*dx + dy*dy);
+      err += sqrt((ax-dx)*(ax-dx) + (ay-dy)*(ay-dy));
+      norm += mag;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    direct = tsNs(&t1, &t0)/1e6 * n / BENCH_SAMPLE;
+
+    printf("%8d %10.2f %11.1f %13.2f %13.1f %7.2f%%\n", n, ms, (double)(t.opened + t.used)/n/BENCH_STEPS, ms*1e6/(n*log2(n)), direct, 100.0*err/norm);
+    fflush(stdout);
+  }
+  free(t.nodes);
+  free(b);
+}
+
+/* golden frames */
+
+unsigned long cellsHash(chtype* cells, int n) {
+  // FNV-1a over the cells, glyph and attributes both
+  unsigned long h = 14695981039346656037UL;
+  unsigned char* p = (unsigned char*)cells;
+  int i;
+
+  for (i = 0; i < n*(int)sizeof(chtype); i++) {
+    h = (h ^ p[i]) * 1099511628211UL;
+  }
+  return h;
+}
+
+void cellsDump(FILE* fp, char* name, chtype* cells, int w, int h) {
+  int x, y;
+
+  fprintf(fp, "%s:\n", name);
+  for (y = 0; y < h; y++) {
+    for (x = 0; x < w; x++) {
+      fputc(cells[y*w+x] & A_CHARTEXT, fp);
+    }
+    fputc('\n', fp);
+  }
+}
+
+int goldenRun() {
+  // a seeded, scripted game drawn headless through the cell buffer and
+  // through copywin, compared cell for cell after every frame
+  chtype *ref, *prev;
+  struct timespec tick, t0, t1;
+  long n, bad = 0, badCells, changed = 0, cellNs = 0, cursesNs = 0;
+  int i, cells, first;
+
+  setenv("TERM", "xterm", 0);
+  setenv("COLUMNS", GOLDEN_W, 0);
+  setenv("LINES", GOLDEN_H, 0);
+  nSessions = 1;
+  sessions = calloc(1, sizeof(gSession));
+  gs = &sessions[0];
+  gs->in = fopen("/dev/null", "r");
+  gs->fd = -1;
+  gs->tty = -1;
+  gs->stats.status = GAME_TITLE;
+  srandom(goldenSeed);
+  gamePlay();
+
+  cells = gs->frame.w*gs->frame.h;
+  ref = calloc(cells, sizeof(chtype));
+  prev = calloc(cells, sizeof(chtype));
+  memset(&tick, 0, sizeof(tick));
+  printf("golden: %dx%d, seed %u, %ld frames\n", gs->frame.w, gs->frame.h, goldenSeed, golden);
+  for (n = 0; n < golden; n++) {
+    if (n % (RENDER_FPS / FPS) == 0) {
+      inputApply(keyCommand(goldenKeys[(n / (RENDER_FPS / FPS)) % strlen(goldenKeys)]));
+      tick.tv_sec++; // readInput only wants it later than any key, and none come
+      handleTimer(&tick);
+      if (gs->stats.status == GAME_PLAY) {
+	gs->alpha = 0.0;
+      }
+    } else if (gs->stats.status == GAME_PLAY) {
+      gs->alpha = (double)(n % (RENDER_FPS / FPS)) / (RENDER_FPS / FPS);
+    }
+    renderScene(gs->alpha);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    frameCompose(&gs->frame, renderBands());
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    cellNs += tsNs(&t1, &t0);
+    frameCopywin(&gs->frame, gs->wBattleField, gs->wEmpty);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    cursesNs += tsNs(&t0, &t1);
+    gs->renderFrames++;
+
+    readCells(gs->wBattleField, ref, gs->frame.w, gs->frame.h);
+    badCells = 0;
+    first = -1;
+    for (i = 0; i < cells; i++) {
+      if (ref[i] != gs->frame.cells[i]) {
+	if (first < 0) {
+	  first = i;
+	}
+	badCells++;
+      }
+      changed += ref[i] != prev[i]; // what the terminal would be sent
+    }
+    memcpy(prev, ref, cells*sizeof(chtype));
+    if (badCells) {
+      printf("frame %6ld: %ld cells differ, first at %d,%d: cells %08lx copywin %08lx\n", n, badCells, first % gs->frame.w, first / gs->frame.w, (unsigned long)gs->frame.cells[first], (unsigned long)ref[first]);
+      if (bad++ == 0) {
+	cellsDump(stdout, "cells", gs->frame.cells, gs->frame.w, gs->frame.h);
+	cellsDump(stdout, "copywin", ref, gs->frame.w, gs->frame.h);
+      }
+    } else if (n % GOLDEN_EVERY == GOLDEN_EVERY-1) {
+      printf("frame %6ld: %016lx\n", n, cellsHash(ref, cells));
+    }
+  }
+  endwin();
+
+  printf("%8s %10s %12s\n", "backend", "ms/frame", "identical");
+  printf("%8s %10.4f %12s\n", "copywin", cursesNs/1e6/golden, "reference");
+  printf("%8s %10.4f %5ld/%-6ld\n", "cells", cellNs/1e6/golden, golden - bad, golden);
+  printf("blits: %.0f cells written a frame, %.0f as whole rectangles; %.0f cells changed a frame\n", (double)gs->frame.cellsWritten/golden, (double)gs->frame.cellsRect/golden, (double)changed/golden);
+  return bad == 0 ? 0 : 1;
 }
 
 int main(int argc, char *argv[]) {
   
+  int opt, fd, i;
+  struct sigaction resizeAction;
+
+  renderThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  while ((opt = getopt(argc, argv, "bcg:ij:o:s:w:")) != -1) {
+    switch (opt) {
+    case 'b':
+      benchmark = 1;
+      break;
+    case 'c':
+      renderCurses = 1;
+      break;
+    case 'g':
+      golden = atol(optarg);
+      break;
+    case 'i':
+      instrument = 1;
+      break;
+    case 'j':
+      renderThreads = atoi(optarg);
+      break;
+    case 'o':
+      instrPath = optarg;
+      break;
+    case 's':
+      goldenSeed = strtoul(optarg, NULL, 10);
+      break;
+    case 'w':
+      gravity = 1;
+      gravityTheta = atof(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-b] [-c] [-g frames [-s seed]] [-i] [-j threads] [-o file] [-w theta] [tty ...]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (renderThreads < 1) {
+    renderThreads = 1;
+  } else if (renderThreads > MAX_RENDER_THREADS) {
+    renderThreads = MAX_RENDER_THREADS;
+  }
+  if (benchmark) {
+    if (gravity) {
+      benchGravity();
+    } else {
+      benchRender();
+    }
+    exit(0);
+  }
+  if (golden > 0) {
+    exit(goldenRun());
+  }
+
   srand((unsigned) time(&t));
-  stats.status = GAME_TITLE;
-  gamePlay();
-  setUpTimer();
 
-  while(1) {
-    usleep(DELAY*1);
-    readInput();
+  // with ttys named, host a game on each of them rather than on this terminal
+  serving = optind < argc;
+  nSessions = serving ? argc - optind : 1;
+  sessions = calloc(nSessions, sizeof(gSession));
+  for (i = 0; i < nSessions; i++) {
+    gs = &sessions[i];
+    gs->id = i;
+    if (serving) {
+      if ((fd = open(argv[optind+i], O_RDWR | O_NOCTTY)) < 0) {
+	perror(argv[optind+i]);
+	exit(1);
+      }
+      gs->fd = fd;
+      gs->in = fdopen(fd, "r");
+      gs->tty = open(argv[optind+i], O_WRONLY | O_NOCTTY | O_NONBLOCK);
+    } else {
+      gs->fd = 0;
+      gs->in = stdin;
+      // opened afresh, so being non-blocking does not leak to the shell's stdout
+      gs->tty = open("/proc/self/fd/1", O_WRONLY | O_NOCTTY | O_NONBLOCK);
     }
+    if (gs->tty < 0) {
+      perror("tty");
+      exit(1);
+    }
+    gs->stats.status = GAME_TITLE;
+    gamePlay();
+  }
+  gs = &sessions[0];
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  metricsOpen();
+
+  if (pipe(wakeFds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+  fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
+  fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
+  writerStart();
+  // curses' own handlers only reach the file it draws into
+  memset(&resizeAction, 0, sizeof(resizeAction));
+  resizeAction.sa_handler = &handleInterrupt;
+  sigaction(SIGINT, &resizeAction, NULL);
+  sigaction(SIGTERM, &resizeAction, NULL);
+  if (serving) {
+    sessionPoolStart(renderThreads);
+  } else {
+    cursesEnter();
+    caEnter = tigetstr("smcup");
+    caExit = tigetstr("rmcup");
+    cursesLeave();
+    resizeAction.sa_handler = &handleStop;
+    sigaction(SIGTSTP, &resizeAction, NULL);
+    resizeAction.sa_handler = &handleResize;
+    sigaction(SIGWINCH, &resizeAction, NULL);
+  }
+  pthread_create(&inputThread, NULL, inputLoop, NULL);
+  timerLoop();
   endwin();
 }